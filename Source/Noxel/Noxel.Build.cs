@@ -10,7 +10,7 @@ public class Noxel : ModuleRules
 
     public Noxel(ReadOnlyTargetRules Target) : base(Target)
     {
-        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "RHI", "RenderCore", "JsonUtilities", "RuntimeMeshComponent", "UMG" });
+        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "RHI", "RenderCore", "JsonUtilities", "RuntimeMeshComponent", "UMG", "NetCore" });
 
         PrivateDependencyModuleNames.AddRange(new string[] {"Json", "RuntimeMeshComponent", "Slate", "SlateCore", "NoxelRenderer" });
     }
@@ -194,7 +194,7 @@ bool FEditorQueue::RunQueue(bool bShouldExecute = true)
 	{
 		for (int i = 0; i < AffArr.Num(); ++i)
 		{
-			AffArr[i]->UpdateMesh();
+			AffArr[i]->QueueMeshUpdate(); //Components affected by several queues in the same frame are only updated once
 		}
 	}
 	//if failed, undo all
@@ -232,7 +232,7 @@ void FEditorQueue::AddNodeReferenceOrder(TArray<FVector> Locations, UNodesContai
 	Orders.Add(order);
 }
 
-TMap<FNodeID, int32> FEditorQueue::CreateNodeReferenceOrdersFromNodeList(TArray<FNodeID> Nodes)
+TMap<FNodeID, int32> FEditorQueue::CreateNodeReferenceOrdersFromNodeList(TArrayView<const FNodeID> Nodes)
 {
 	TArray<UNodesContainer*> Containers;
 	TArray<TArray<FNodeID>> SortedNodes;
@@ -264,7 +264,7 @@ TMap<FNodeID, int32> FEditorQueue::CreateNodeReferenceOrdersFromNodeList(TArray<
 	return NodeMap;
 }
 
-TArray<int32> FEditorQueue::NodeListToNodeReferences(TArray<FNodeID> Nodes, const TMap<FNodeID, int32> &NodeMap)
+TArray<int32> FEditorQueue::NodeListToNodeReferences(TArrayView<const FNodeID> Nodes, const TMap<FNodeID, int32> &NodeMap)
 {
 	TArray<int32> NodeRef;
 	for (FNodeID Node : Nodes)
@@ -434,7 +434,10 @@ bool FEditorQueueOrderNodeReference::ExecuteOrder(FEditorQueue* Parent)
 {
 	for (int i = 0; i < Locations.Num(); ++i)
 	{
-		Parent->NodeReferences.Add(FNodeID(Container, Locations[i]));
+		//Existing nodes are referenced by handle, new nodes get theirs when they are added
+		FNodeID Node(Container, Locations[i]);
+		Container->FindNode(Locations[i], Node);
+		Parent->NodeReferences.Add(Node);
 	}
 	return true;
 }
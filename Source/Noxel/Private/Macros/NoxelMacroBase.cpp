@@ -217,7 +217,7 @@ FVector ANoxelMacroBase::GetNodePlacement(float PlacementDistance, UNodesContain
 
 void ANoxelMacroBase::SetNodeColor(FNodeID id, ENoxelColor color)
 {
-	if (id.Object->SetNodeColor(id.Location, UFunctionLibrary::getColorFromJson(color))) 
+	if (id.Object->SetNodeColor(id, UFunctionLibrary::getColorFromJson(color))) 
 	{
 		if (color != ENoxelColor::NodeInactive) {
 			ColoredNodes.AddUnique(id);
@@ -234,10 +234,21 @@ void ANoxelMacroBase::SetNodeColor(FNodeID id, ENoxelColor color)
 
 void ANoxelMacroBase::ResetNodesColor()
 {
-	for (int32 i = ColoredNodes.Num() -1; i>= 0; i--)
+	//Grouped by container so that each one sends its colors to the renderer once
+	TMap<UNodesContainer*, TArray<FNodeID>> NodesByContainer;
+	for (const FNodeID& id : ColoredNodes)
 	{
-		SetNodeColor(ColoredNodes[i], ENoxelColor::NodeInactive);
+		if (id.IsValid())
+		{
+			NodesByContainer.FindOrAdd(id.Object).Add(id);
+		}
+	}
+	const FColor InactiveColor = UFunctionLibrary::getColorFromJson(ENoxelColor::NodeInactive);
+	for (const TPair<UNodesContainer*, TArray<FNodeID>>& ContainerNodes : NodesByContainer)
+	{
+		ContainerNodes.Key->SetNodesColor(ContainerNodes.Value, InactiveColor);
 	}
+	ColoredNodes.Empty();
 }
 
 // Getting actors --------------------------------------------------------------------------------------------------------------------------------
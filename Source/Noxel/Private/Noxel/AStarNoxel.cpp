@@ -134,7 +134,7 @@ TArray<FNodeID> AStarNoxel::getConnectedNodes(FNodeID node)
 			Cache.Emplace(owner, ConnectedRaw);
 		}
 	}
-	TArray<int32> ConnectedPanels = node.Object->GetAttachedPanels(node);
+	TArrayView<const int32> ConnectedPanels = node.Object->GetAttachedPanels(node);
 	for (int32 connectedpanel : ConnectedPanels)
 	{
 		FPanelData ConnectedPanelData;
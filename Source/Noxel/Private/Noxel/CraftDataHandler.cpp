@@ -776,7 +776,10 @@ bool UCraftDataHandler::loadNodesContainer(UNodesContainer * NodesContainer, int
 		for (int i = 0; i < SavedData.Nodes.Num(); i++)
 		{
 			FNodeID NewNode = FNodeID(NodesContainer, SavedData.Nodes[i]);
-			NodesContainer->AddNode(NewNode);
+			if (!UNodesContainer::AddNode(NewNode) && !NodesContainer->FindNode(SavedData.Nodes[i], NewNode))
+			{
+				continue; //Neither added nor already there, the panels using it can't be connected
+			}
 			RedirectorMap.Add(FNodeSavedRedirector(parentIndex, nodesContainerIndex, i), NewNode);
 		}
 	}
@@ -806,10 +809,10 @@ void UCraftDataHandler::saveNoxelContainer(const UNoxelContainer * NoxelContaine
 {
 	SavedData = FNoxelContainerSave(NoxelContainer->GetName());
 
-	TArray<FPanelData> Panels = NoxelContainer->GetPanels();
+	const TArray<FPanelData>& Panels = NoxelContainer->GetPanels();
 	for (int i = 0; i < Panels.Num(); i++)
 	{
-		FPanelData data = Panels[i];
+		const FPanelData& data = Panels[i];
 		FPanelSavedData panel = FPanelSavedData(data);
 		for (FNodeID node : data.Nodes)
 		{
@@ -831,12 +834,18 @@ bool UCraftDataHandler::loadNoxelContainer(UNoxelContainer * NoxelContainer, TMa
 		return false;
 	}
 	//Delete all old panels
-	TArray<FPanelData> OldPanels = NoxelContainer->GetPanels();
-	for (int i = 0; i < OldPanels.Num(); i++)
+	TArray<int32> OldPanelIndices;
+	for (const FPanelData& OldPanel : NoxelContainer->GetPanels())
 	{
-		NoxelContainer->RemovePanel(OldPanels[i].PanelIndex);
+		OldPanelIndices.Add(OldPanel.PanelIndex);
+	}
+	for (int32 OldPanelIndex : OldPanelIndices)
+	{
+		NoxelContainer->RemovePanel(OldPanelIndex);
 	}
 
+	TArray<FPanelData> NewPanels;
+	NewPanels.Reserve(SavedData.Panels.Num());
 	for (int i = 0; i < SavedData.Panels.Num(); i++)
 	{
 		//Rebuild the panel data
@@ -848,10 +857,9 @@ bool UCraftDataHandler::loadNoxelContainer(UNoxelContainer * NoxelContainer, TMa
 				nodes.Add(*RedirectorMap.Find(SData.Nodes[j]));
 			}
 		}
-		const FPanelData data = FPanelData(nodes, SData.ThicknessNormal, SData.ThicknessAntiNormal, SData.Virtual);
-
-		NoxelContainer->AddPanel(data);
+		NewPanels.Emplace(nodes, SData.ThicknessNormal, SData.ThicknessAntiNormal, SData.Virtual);
 	}
+	NoxelContainer->AddPanels(NewPanels);
 	NoxelContainer->UpdateMesh();
 	return true;
 }
@@ -7,6 +7,7 @@
 #include "NodesRMCProvider.h"
 
 #include "Net/UnrealNetwork.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "FunctionLibrary.h"
 #include "Noxel/NoxelNetworkingAgent.h"
 
@@ -15,11 +16,14 @@
 UNodesContainer::UNodesContainer()
 	: Super()
 {
-	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bCanEverTick = false; //Mesh updates are batched by UNoxelMeshUpdateSubsystem
 	SetIsReplicatedByDefault(true);
 	NodeSize = 10.0f;
+	LocationTolerance = 0.01f;
 	bPlayerEditable = false;
 	bIsMeshDirty = false;
+	bInstancedRendering = false;
+	NodesInstances = nullptr;
 
 	static ConstructorHelpers::FObjectFinder<UStaticMesh> MeshConstructor(
 		TEXT("StaticMesh'/Game/Meshes/Nodes/Octahedron.Octahedron'"));
@@ -48,6 +52,19 @@ void UNodesContainer::OnRegister()
 	{
 		Nodes[NodeIdx].Color = DefaultNodeColor;
 	}
+	RebuildNodeIndexIfNeeded();
+	RebuildNodeGrid(); //LocationTolerance may have changed
+	if (bInstancedRendering && BaseNodeMesh && !IsCollisionOnly() && !NodesInstances && GetOwner())
+	{
+		NodesInstances = NewObject<UInstancedStaticMeshComponent>(GetOwner(), NAME_None, RF_Transient);
+		NodesInstances->SetupAttachment(this);
+		NodesInstances->SetStaticMesh(BaseNodeMesh);
+		NodesInstances->SetMaterial(0, NodeMaterial);
+		NodesInstances->NumCustomDataFloats = 4;
+		NodesInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision); //Traces hit the provider's collision
+		NodesInstances->RegisterComponent();
+	}
+	NodesProvider->SetCollisionOnly(IsCollisionOnly() || NodesInstances != nullptr);
 	NodesProvider->SetWantedMeshBounds(FBoxSphereBounds(FVector::ZeroVector, FVector::OneVector * NodeSize, NodeSize));
 	NodesProvider->SetStaticMesh(BaseNodeMesh);
 	NodesProvider->SetNodesMaterial(NodeMaterial);
@@ -55,6 +72,16 @@ void UNodesContainer::OnRegister()
 	Initialize(NodesProvider);
 }
 
+void UNodesContainer::OnComponentDestroyed(bool bDestroyingHierarchy)
+{
+	if (NodesInstances)
+	{
+		NodesInstances->DestroyComponent();
+		NodesInstances = nullptr;
+	}
+	Super::OnComponentDestroyed(bDestroyingHierarchy);
+}
+
 void UNodesContainer::BeginPlay()
 {
 	Super::BeginPlay();
@@ -84,20 +111,36 @@ void UNodesContainer::PostInitProperties()
 	Super::PostInitProperties();
 }
 
-void UNodesContainer::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UNodesContainer::PostLoad()
+{
+	Super::PostLoad();
+	RebuildNodeIndexIfNeeded();
+}
+
+#if WITH_EDITOR
+void UNodesContainer::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-	if (bIsMeshDirty)
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	const FName PropertyName = PropertyChangedEvent.GetPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UNodesContainer, Nodes))
 	{
-		//UE_LOG(NoxelData, Log, TEXT("[UNodesContainer::TickComponent] Updating mesh from tick because it's dirty"));
-		UpdateMesh();
+		RebuildNodeIndex();
+	}
+	else if (PropertyName == GET_MEMBER_NAME_CHECKED(UNodesContainer, LocationTolerance))
+	{
+		RebuildNodeGrid();
 	}
 }
+#endif
 
 void UNodesContainer::SetNodeSize(float NewNodeSize)
 {
 	NodeSize = NewNodeSize;
 	NodesProvider->SetWantedMeshBounds(FBoxSphereBounds(FVector::ZeroVector, FVector::OneVector * NodeSize, NodeSize));
+	if (NodesInstances)
+	{
+		MarkMeshDirty(); //Instance transforms depend on the node size
+	}
 }
 
 UNoxelContainer* UNodesContainer::GetAttachedNoxel() const
@@ -107,21 +150,30 @@ UNoxelContainer* UNodesContainer::GetAttachedNoxel() const
 
 bool UNodesContainer::AddNode(FVector Location)
 {
-	//TODO : Handle overlap
-	if (!Nodes.Contains(Location))
+	FNodeHandle Handle;
+	return AddNode(Location, Handle);
+}
+
+bool UNodesContainer::AddNode(FVector Location, FNodeHandle& OutHandle)
+{
+	//Overlapping nodes are refused
+	if (FindNodeIndex(Location) == INDEX_NONE)
 	{
-		Nodes.Emplace(Location, DefaultNodeColor);
+		const int32 NodeIdx = Nodes.Emplace(Location, DefaultNodeColor);
+		NodeGrid.Add(LocationToCell(Location), NodeIdx);
+		OutHandle = AllocateSlot(NodeIdx);
+		NodeHandles.Add(OutHandle);
 		MarkMeshDirty();
 		return true;
 	}
 	return false;
 }
 
-bool UNodesContainer::AddNode(FNodeID Node)
+bool UNodesContainer::AddNode(FNodeID& Node)
 {
 	if (Node.IsValid())
 	{
-		return Node.Object->AddNode(Node.Location);
+		return Node.Object->AddNode(Node.Location, Node.Handle);
 	}
 	return false;
 }
@@ -133,17 +185,18 @@ bool UNodesContainer::SetNodesDefault(TArray<FVector> InNodes, bool bInPlayerEdi
 	{
 		Nodes.Emplace(location);
 	}
+	RebuildNodeIndex();
 	bPlayerEditable = bInPlayerEditable;
 	return true;
 }
 
-bool UNodesContainer::AttachNode(const FVector Location, const FPanelID Panel)
+bool UNodesContainer::AttachNode(const FNodeID& Node, const FPanelID Panel)
 {
 	if (AttachedNoxel && Panel.Object != AttachedNoxel)
 	{
 		return false;
 	}
-	int32 NodeIdx = Nodes.Find(Location);
+	int32 NodeIdx = FindNodeIndex(Node);
 	if (NodeIdx != INDEX_NONE)
 	{
 		if (Nodes[NodeIdx].ConnectedPanels.Num() == 0)
@@ -157,9 +210,9 @@ bool UNodesContainer::AttachNode(const FVector Location, const FPanelID Panel)
 	return false;
 }
 
-bool UNodesContainer::DetachNode(const FVector Location, const FPanelID Panel)
+bool UNodesContainer::DetachNode(const FNodeID& Node, const FPanelID Panel)
 {
-	int32 NodeIdx = Nodes.Find(Location);
+	int32 NodeIdx = FindNodeIndex(Node);
 	if (NodeIdx != INDEX_NONE)
 	{
 		int32 numRemoved = Nodes[NodeIdx].ConnectedPanels.Remove(Panel);
@@ -178,68 +231,109 @@ bool UNodesContainer::DetachNode(const FVector Location, const FPanelID Panel)
 
 bool UNodesContainer::RemoveNode(FVector Location)
 {
-	int32 NodeIdx = Nodes.Find(Location);
-	if (NodeIdx != INDEX_NONE)
-	{
-		if (Nodes[NodeIdx].ConnectedPanels.Num() != 0)
-		{
-			return false;
-		}
-		Nodes.RemoveAt(NodeIdx);
-		MarkMeshDirty();
-		return true;
-	}
-	return false;
+	FNodeID Node;
+	return FindNode(Location, Node) && RemoveNode(Node);
 }
 
 bool UNodesContainer::RemoveNode(FNodeID Node)
 {
-	if (Node.IsValid())
+	if (!Node.IsValid())
+	{
+		return false;
+	}
+	UNodesContainer* Container = Node.Object;
+	const int32 NodeIdx = Container->FindNodeIndex(Node);
+	if (NodeIdx == INDEX_NONE || Container->Nodes[NodeIdx].ConnectedPanels.Num() != 0)
 	{
-		return Node.Object->RemoveNode(Node.Location);
+		return false;
 	}
-	return false;
+	Container->RemoveNodeAt(NodeIdx);
+	Container->MarkMeshDirty();
+	return true;
 }
 
-bool UNodesContainer::SetNodeColor(FVector Location, FColor color)
+bool UNodesContainer::SetNodeColor(const FNodeID& Node, FColor color)
 {
-	int32 NodeIdx = Nodes.Find(Location);
+	int32 NodeIdx = FindNodeIndex(Node);
 	if (NodeIdx != INDEX_NONE)
 	{
 		Nodes[NodeIdx].Color = color;
-		MarkMeshDirty();
+		PatchNodesColor({ NodeIdx });
 		return true;
 	}
 	return false;
 }
 
+bool UNodesContainer::SetNodesColor(const TArray<FNodeID>& InNodes, FColor color)
+{
+	TArray<int32> NodeIndices;
+	NodeIndices.Reserve(InNodes.Num());
+	for (const FNodeID& Node : InNodes)
+	{
+		int32 NodeIdx = FindNodeIndex(Node);
+		if (NodeIdx != INDEX_NONE)
+		{
+			Nodes[NodeIdx].Color = color;
+			NodeIndices.Add(NodeIdx);
+		}
+	}
+	PatchNodesColor(NodeIndices);
+	return NodeIndices.Num() == InNodes.Num();
+}
+
 bool UNodesContainer::FindNode(FVector Location, FNodeID& FoundNode)
 {
-	int32 NodeIdx = Nodes.Find(Location);
+	int32 NodeIdx = FindNodeIndex(Location);
 	if (NodeIdx != INDEX_NONE)
 	{
-		FoundNode = Nodes[NodeIdx].ToNodeID(this);
+		FoundNode = Nodes[NodeIdx].ToNodeID(this, NodeHandles[NodeIdx]);
 		return true;
 	}
 	return false;
 }
 
-TArray<int32> UNodesContainer::GetAttachedPanels(FVector Location) const
+bool UNodesContainer::ResolveNode(FNodeID& Node)
+{
+	if (!Node.IsValid())
+	{
+		return false;
+	}
+	if (Node.Handle.IsSet())
+	{
+		return Node.Object->ResolveNodeHandle(Node.Handle) != INDEX_NONE;
+	}
+	return Node.Object->FindNode(Node.Location, Node);
+}
+
+TArrayView<const int32> UNodesContainer::GetAttachedPanels(const FNodeID& Node) const
 {
-	int32 NodeIdx = Nodes.Find(Location);
+	int32 NodeIdx = FindNodeIndex(Node);
 	if (NodeIdx != INDEX_NONE)
 	{
 		return Nodes[NodeIdx].ConnectedPanels;
 	}
-	return TArray<int32>();
+	return TArrayView<const int32>();
+}
+
+SIZE_T UNodesContainer::GetNodesAllocatedSize() const
+{
+	SIZE_T Size = Nodes.GetAllocatedSize() + NodeGrid.GetAllocatedSize() + NodeHandles.GetAllocatedSize()
+		+ SlotNodeIndices.GetAllocatedSize() + SlotGenerations.GetAllocatedSize() + FreeSlots.GetAllocatedSize();
+	for (const FNodeData& Node : Nodes)
+	{
+		Size += Node.ConnectedPanels.GetAllocatedSize(); //Zero unless the node outgrew its inline storage
+	}
+	return Size;
 }
 
 TArray<FNodeID> UNodesContainer::GenerateNodesKeyArray() const
 {
+	check(NodeHandles.Num() == Nodes.Num());
 	TArray<FNodeID> Keys;
-	for (FNodeData Node : Nodes)
+	Keys.Reserve(Nodes.Num());
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); NodeIdx++)
 	{
-		Keys.Add(Node.ToNodeID(this));
+		Keys.Add(Nodes[NodeIdx].ToNodeID(this, NodeHandles[NodeIdx]));
 	}
 	return Keys;
 }
@@ -251,24 +345,19 @@ bool UNodesContainer::GetNodeHit(FHitResult Hit, FNodeID& HitNode)
 		if (Hit.GetComponent()->IsA<UNodesContainer>())
 		{
 			UNodesContainer* HitComp = Cast<UNodesContainer>(Hit.GetComponent());
-			if (Hit.FaceIndex != INDEX_NONE)
+			//The trace is tested against the spheres of the nodes, so that the hit doesn't depend on the layout of the collision mesh
+			const FTransform& ComponentTransform = HitComp->GetComponentTransform();
+			int32 HitNodeIdx;
+			if (HitComp->NodesProvider->GetNodeOnRay(ComponentTransform.InverseTransformPosition(Hit.TraceStart),
+				ComponentTransform.InverseTransformPosition(Hit.TraceEnd), HitNodeIdx) && HitComp->NodeHandles.IsValidIndex(HitNodeIdx))
 			{
-				int32 HitNodeIdx;
-				if (HitComp->NodesProvider->GetHitNodeIndex(Hit.FaceIndex, HitNodeIdx))
-				{
-					HitNode = FNodeID(HitComp, HitComp->Nodes[HitNodeIdx].Location);
-					return true;
-				}
-				else
-				{
-					UE_LOG(NoxelData, Warning,
-					       TEXT("[UNodesContainer::GetNodeHit] Failed because it couldn't find a hit node"));
-				}
+				HitNode = HitComp->Nodes[HitNodeIdx].ToNodeID(HitComp, HitComp->NodeHandles[HitNodeIdx]);
+				return true;
 			}
 			else
 			{
 				UE_LOG(NoxelData, Warning,
-				       TEXT("[UNodesContainer::GetNodeHit] Failed because face index is INDEX_NONE"));
+				       TEXT("[UNodesContainer::GetNodeHit] Failed because it couldn't find a hit node"));
 			}
 		}
 		else
@@ -292,6 +381,132 @@ bool UNodesContainer::IsPlayerEditable() const
 void UNodesContainer::MarkMeshDirty()
 {
 	bIsMeshDirty = true;
+	QueueMeshUpdate();
+}
+
+FIntVector UNodesContainer::LocationToCell(const FVector& Location) const
+{
+	const float CellSize = FMath::Max(LocationTolerance, KINDA_SMALL_NUMBER);
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+}
+
+int32 UNodesContainer::FindNodeIndex(const FVector& Location) const
+{
+	//A node within tolerance is at most one cell away
+	const FIntVector Cell = LocationToCell(Location);
+	const float ToleranceSquared = FMath::Square(LocationTolerance);
+	int32 ClosestNodeIdx = INDEX_NONE;
+	float ClosestDistanceSquared = MAX_flt;
+	for (int32 X = -1; X <= 1; X++)
+	{
+		for (int32 Y = -1; Y <= 1; Y++)
+		{
+			for (int32 Z = -1; Z <= 1; Z++)
+			{
+				for (auto It = NodeGrid.CreateConstKeyIterator(Cell + FIntVector(X, Y, Z)); It; ++It)
+				{
+					const float DistanceSquared = FVector::DistSquared(Nodes[It.Value()].Location, Location);
+					if (DistanceSquared <= ToleranceSquared && DistanceSquared < ClosestDistanceSquared)
+					{
+						ClosestDistanceSquared = DistanceSquared;
+						ClosestNodeIdx = It.Value();
+					}
+				}
+			}
+		}
+	}
+	return ClosestNodeIdx;
+}
+
+int32 UNodesContainer::FindNodeIndex(const FNodeID& Node) const
+{
+	if (Node.Object != this || !Node.Handle.IsSet())
+	{
+		return INDEX_NONE;
+	}
+	//A handle that doesn't resolve means the node was removed, even if another node was added at its location since
+	return ResolveNodeHandle(Node.Handle);
+}
+
+void UNodesContainer::RebuildNodeGrid()
+{
+	NodeGrid.Reset();
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); NodeIdx++)
+	{
+		NodeGrid.Add(LocationToCell(Nodes[NodeIdx].Location), NodeIdx);
+	}
+}
+
+void UNodesContainer::RebuildNodeIndex()
+{
+	for (int32 Slot = 0; Slot < SlotNodeIndices.Num(); Slot++)
+	{
+		SlotGenerations[Slot]++;
+		if (SlotNodeIndices[Slot] != INDEX_NONE)
+		{
+			SlotNodeIndices[Slot] = INDEX_NONE;
+			FreeSlots.Add(Slot);
+		}
+	}
+	NodeHandles.Reset(Nodes.Num());
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); NodeIdx++)
+	{
+		NodeHandles.Add(AllocateSlot(NodeIdx));
+	}
+	RebuildNodeGrid();
+}
+
+void UNodesContainer::RebuildNodeIndexIfNeeded()
+{
+	//Every edit through AddNode and RemoveNode keeps the handles parallel to Nodes
+	if (NodeHandles.Num() != Nodes.Num())
+	{
+		RebuildNodeIndex();
+	}
+}
+
+int32 UNodesContainer::ResolveNodeHandle(FNodeHandle Handle) const
+{
+	if (SlotNodeIndices.IsValidIndex(Handle.Slot) && SlotGenerations[Handle.Slot] == Handle.Generation)
+	{
+		return SlotNodeIndices[Handle.Slot];
+	}
+	return INDEX_NONE;
+}
+
+FNodeHandle UNodesContainer::AllocateSlot(int32 NodeIdx)
+{
+	int32 Slot;
+	if (FreeSlots.Num() != 0)
+	{
+		Slot = FreeSlots.Pop(false);
+		SlotNodeIndices[Slot] = NodeIdx;
+	}
+	else
+	{
+		Slot = SlotNodeIndices.Add(NodeIdx);
+		SlotGenerations.Add(0);
+	}
+	return FNodeHandle(Slot, SlotGenerations[Slot]);
+}
+
+void UNodesContainer::RemoveNodeAt(int32 NodeIdx)
+{
+	const int32 LastNodeIdx = Nodes.Num() - 1;
+	NodeGrid.Remove(LocationToCell(Nodes[NodeIdx].Location), NodeIdx);
+	if (NodeIdx != LastNodeIdx)
+	{
+		NodeGrid.Remove(LocationToCell(Nodes[LastNodeIdx].Location), LastNodeIdx);
+		NodeGrid.Add(LocationToCell(Nodes[LastNodeIdx].Location), NodeIdx);
+		SlotNodeIndices[NodeHandles[LastNodeIdx].Slot] = NodeIdx;
+	}
+	//Free the slot, the generation change invalidates the handles still pointing to it
+	const int32 Slot = NodeHandles[NodeIdx].Slot;
+	SlotNodeIndices[Slot] = INDEX_NONE;
+	SlotGenerations[Slot]++;
+	FreeSlots.Add(Slot);
+	Nodes.RemoveAtSwap(NodeIdx);
+	NodeHandles.RemoveAtSwap(NodeIdx);
 }
 
 void UNodesContainer::UpdateMesh()
@@ -315,6 +530,68 @@ void UNodesContainer::UpdateMesh()
 		NodesProvider->SetNodes({});
 		SetVisibility(false); //hack because sometimes the proxy isn't recreated
 	}
+	if (NodesInstances)
+	{
+		UpdateNodesInstances();
+	}
+}
+
+void UNodesContainer::PatchNodesColor(const TArray<int32>& NodeIndices)
+{
+	if (bIsMeshDirty || SpawnContext == ECraftSpawnContext::Battle)
+	{
+		return; //The pending update will send the new colors, or there is nothing rendered
+	}
+	TArray<TPair<int32, FColor>> Colors;
+	Colors.Reserve(NodeIndices.Num());
+	for (int32 NodeIdx : NodeIndices)
+	{
+		Colors.Emplace(NodeIdx, Nodes[NodeIdx].Color);
+	}
+	NodesProvider->SetNodesColor(Colors);
+	if (NodesInstances)
+	{
+		for (int32 NodeIdx : NodeIndices)
+		{
+			const FLinearColor Color = Nodes[NodeIdx].Color.ReinterpretAsLinear();
+			NodesInstances->SetCustomData(NodeIdx, { Color.R, Color.G, Color.B, Color.A });
+		}
+		NodesInstances->MarkRenderStateDirty();
+	}
+}
+
+FTransform UNodesContainer::GetNodeInstanceTransform(FVector Location) const
+{
+	const FBoxSphereBounds MeshBounds = BaseNodeMesh->GetBounds();
+	const FVector Scale = FVector::OneVector * NodeSize / MeshBounds.BoxExtent;
+	return FTransform(FQuat::Identity, Location - MeshBounds.Origin * Scale, Scale);
+}
+
+void UNodesContainer::UpdateNodesInstances()
+{
+	const int32 NumInstances = SpawnContext != ECraftSpawnContext::Battle ? Nodes.Num() : 0;
+	TArray<FTransform> Transforms;
+	Transforms.Reserve(NumInstances);
+	for (int32 NodeIdx = 0; NodeIdx < NumInstances; NodeIdx++)
+	{
+		Transforms.Add(GetNodeInstanceTransform(Nodes[NodeIdx].Location));
+	}
+	if (NodesInstances->GetInstanceCount() == NumInstances)
+	{
+		NodesInstances->BatchUpdateInstancesTransforms(0, Transforms);
+	}
+	else
+	{
+		NodesInstances->ClearInstances();
+		NodesInstances->AddInstances(Transforms, false);
+	}
+	for (int32 NodeIdx = 0; NodeIdx < NumInstances; NodeIdx++)
+	{
+		//Same values as the vertex color of the non instanced mesh
+		const FLinearColor Color = Nodes[NodeIdx].Color.ReinterpretAsLinear();
+		NodesInstances->SetCustomData(NodeIdx, { Color.R, Color.G, Color.B, Color.A });
+	}
+	NodesInstances->MarkRenderStateDirty();
 }
 
 void UNodesContainer::AttachToNoxelContainer(UNoxelContainer* NoxelContainer)
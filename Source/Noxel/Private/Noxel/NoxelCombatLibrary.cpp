@@ -4,6 +4,7 @@
 #include "Noxel.h"
 
 #include "Noxel/AStarNoxel.h"
+#include "Noxel/NodesContainer.h"
 #include "EditorGameState.h"
 #include "Noxel/CraftDataHandler.h"
 #include "NoxelHangarBase.h"
@@ -11,6 +12,11 @@
 
 bool UNoxelCombatLibrary::AreNodeConnected(FNodeID start, FNodeID end)
 {
+	//The search compares ids, which only match once they have their handle
+	if (!UNodesContainer::ResolveNode(start) || !UNodesContainer::ResolveNode(end))
+	{
+		return false;
+	}
 	AStarNoxel instance;
 	return instance.runAStar(start, end);
 }
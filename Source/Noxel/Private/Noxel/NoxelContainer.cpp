@@ -6,10 +6,14 @@
 #include "Noxel/NodesContainer.h"
 #include "NoxelRMCProvider.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Async/ParallelFor.h"
 
 #include "NoxelPlayerController.h"
 #include "Net/UnrealNetwork.h"
 
+//Below this many panels, AddPanels computes their geometry on the calling thread
+#define PANEL_GEOMETRY_PARALLEL_MIN_PANELS 64
+
 
 UNoxelContainer::UNoxelContainer()
 	: Super()
@@ -17,6 +21,7 @@ UNoxelContainer::UNoxelContainer()
 	SetIsReplicatedByDefault(true);
 	SetCollisionProfileName(TEXT("Noxel"));
 	MaxIndex = INT32_MIN;
+	bProviderDataDirty = true;
 
 	NoxelProvider = CreateDefaultSubobject<UNoxelRMCProvider>("NoxelProvider");
 
@@ -33,6 +38,7 @@ void UNoxelContainer::GetLifetimeReplicatedProps(TArray< FLifetimeProperty > & O
 void UNoxelContainer::OnRegister()
 {
 	Super::OnRegister();
+	NoxelProvider->SetCollisionOnly(IsCollisionOnly());
 	Initialize(NoxelProvider);
 }
 
@@ -94,8 +100,8 @@ void UNoxelContainer::TickComponent(float DeltaTime, ELevelTick TickType, FActor
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 }
 
-bool UNoxelContainer::FindPanelsByNodes(TArray<FNodeID>& Nodes, TArray<int32>& OutPanels, TArray<int32>& OutOccurences, 
-	TArray<TArray<FNodeID>>& OutNodesAttachedBy, TArray<int32> IgnoreFilter)
+bool UNoxelContainer::FindPanelsByNodes(TArrayView<const FNodeID> Nodes, TArray<int32>& OutPanels, TArray<int32>& OutOccurences, 
+	TArray<TArray<FNodeID>>& OutNodesAttachedBy, const TArray<int32>& IgnoreFilter)
 {
 	OutPanels.Empty();
 	OutOccurences.Empty();
@@ -103,7 +109,7 @@ bool UNoxelContainer::FindPanelsByNodes(TArray<FNodeID>& Nodes, TArray<int32>& O
 	{
 		if (Node.Object)
 		{
-			TArray<int32> Attached = Node.Object->GetAttachedPanels(Node.Location); //Array of PanelIndex
+			TArrayView<const int32> Attached = Node.Object->GetAttachedPanels(Node); //Array of PanelIndex
 			for (int32 AttachedPanelIndex : Attached)
 			{
 				if (IgnoreFilter.Contains(AttachedPanelIndex))
@@ -128,19 +134,32 @@ bool UNoxelContainer::FindPanelsByNodes(TArray<FNodeID>& Nodes, TArray<int32>& O
 	return OutPanels.Num() > 0;
 }
 
-bool UNoxelContainer::GetIndexOfPanelByPanelIndex(int32 PanelIndex, int32 & OutIndexInArray)
+bool UNoxelContainer::GetIndexOfPanelByPanelIndex(int32 PanelIndex, int32 & OutIndexInArray) const
 {
-	//Find the panel
-	for (int32 PanelIdx = 0; PanelIdx < Panels.Num(); PanelIdx++)
+	const int32* IndexInArray = PanelIndexToArrayIndex.Find(PanelIndex);
+	if (IndexInArray)
 	{
-		FPanelData Panel = Panels[PanelIdx];
-		if (Panel.PanelIndex == PanelIndex) //Panel matches indices
+		OutIndexInArray = *IndexInArray;
+		return true;
+	}
+	return false;
+}
+
+void UNoxelContainer::RemovePanelAt(int32 IndexInArray)
+{
+	PanelIndexToArrayIndex.Remove(Panels[IndexInArray].PanelIndex);
+	Panels.RemoveAtSwap(IndexInArray);
+	if (Panels.IsValidIndex(IndexInArray)) //The last panel was moved into the freed slot
+	{
+		const FPanelData& MovedPanel = Panels[IndexInArray];
+		PanelIndexToArrayIndex[MovedPanel.PanelIndex] = IndexInArray;
+		//The provider's arrays follow the layout of Panels, so the moved panel and the ones pointing to it need an update
+		MarkPanelModified(MovedPanel.PanelIndex);
+		for (int32 OtherPanelIndex : MovedPanel.ConnectedPanels)
 		{
-			OutIndexInArray = PanelIdx;
-			return true;
+			MarkPanelModified(OtherPanelIndex);
 		}
 	}
-	return false;
 }
 
 bool UNoxelContainer::IsPanelValid(FPanelData &data) const
@@ -193,18 +212,30 @@ bool UNoxelContainer::IsPanelValid(FPanelData &data, TArray<int32> &AdjacentPane
 	return true;
 }
 
-void UNoxelContainer::ComputePanelGeometricData(FPanelData& data)
+void UNoxelContainer::GetPanelNodeLocations(const FPanelData& data, TArray<FVector>& OutNodeLocations) const
 {
-	const int32 NumNodes = data.Nodes.Num();
-	TArray<FVector> NodeLocationsRelativeToNoxel;
-	for (FNodeID Node : data.Nodes)
+	const FTransform& ComponentTransform = GetComponentTransform();
+	OutNodeLocations.Reset(data.Nodes.Num());
+	for (const FNodeID& Node : data.Nodes)
 	{
-		NodeLocationsRelativeToNoxel.Add(GetComponentTransform().InverseTransformPosition(Node.ToWorld()));
+		OutNodeLocations.Add(ComponentTransform.InverseTransformPosition(Node.ToWorld()));
 	}
+}
+
+void UNoxelContainer::ComputePanelGeometricData(FPanelData& data)
+{
+	TArray<FVector> NodeLocationsRelativeToNoxel;
+	GetPanelNodeLocations(data, NodeLocationsRelativeToNoxel);
+	ComputePanelGeometricData(data, NodeLocationsRelativeToNoxel);
+}
+
+void UNoxelContainer::ComputePanelGeometricData(FPanelData& data, const TArray<FVector>& NodeLocationsRelativeToNoxel)
+{
+	const int32 NumNodes = data.Nodes.Num();
 	UNoxelRMCProvider::PlaneFit(NodeLocationsRelativeToNoxel, data.Center, data.Normal);
 	TArray<int32> NewNodesIndex;
 	UNoxelRMCProvider::ReorderNodes(NodeLocationsRelativeToNoxel, data.Center, data.Normal, NewNodesIndex);
-	TArray<FNodeID> NewNodes;
+	FPanelNodesArray NewNodes;
 	NewNodes.Reserve(NumNodes);
 	for (int32 CurrentNodeIdx = 0; CurrentNodeIdx < NumNodes; CurrentNodeIdx++)
 	{
@@ -214,49 +245,116 @@ void UNoxelContainer::ComputePanelGeometricData(FPanelData& data)
 	data.Area = UNoxelRMCProvider::ComputeTriangleFanArea(data.Center, NodeLocationsRelativeToNoxel);
 }
 
-void UNoxelContainer::GetAdjacentPanelsFromNodes(FPanelData& data, const TArray<int32>& AdjacentPanels,
-                                                 const TArray<int32>& Occurrences, const TArray<TArray<FNodeID>>& NodesAttachedBy)
+void UNoxelContainer::RegisterPanelEdges(const FPanelData& data)
 {
-	
 	const int32 NumNodes = data.Nodes.Num();
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		TArray<int32>& EdgePanels = EdgeToPanels.FindOrAdd(FNodeEdge(data.Nodes[NodeIdx], data.Nodes[(NodeIdx + 1) % NumNodes]));
+		for (int32 OtherPanelIndex : EdgePanels) //Side adjacency of the other panels changes
+		{
+			MarkPanelModified(OtherPanelIndex);
+		}
+		EdgePanels.AddUnique(data.PanelIndex);
+	}
+}
+
+void UNoxelContainer::UnregisterPanelEdges(const FPanelData& data)
+{
+	const int32 NumNodes = data.Nodes.Num();
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		const FNodeEdge Edge(data.Nodes[NodeIdx], data.Nodes[(NodeIdx + 1) % NumNodes]);
+		TArray<int32>* EdgePanels = EdgeToPanels.Find(Edge);
+		if (EdgePanels)
+		{
+			EdgePanels->RemoveSwap(data.PanelIndex);
+			for (int32 OtherPanelIndex : *EdgePanels)
+			{
+				MarkPanelModified(OtherPanelIndex);
+			}
+			if (EdgePanels->Num() == 0)
+			{
+				EdgeToPanels.Remove(Edge);
+			}
+		}
+	}
+}
+
+void UNoxelContainer::MarkPanelDiffered(const FPanelData& data)
+{
+	if (!DifferedPanels.Contains(data.PanelIndex)) //Edges are only registered while the panel isn't differed
+	{
+		UnregisterPanelEdges(data);
+		DifferedPanels.Add(data.PanelIndex);
+	}
+}
 
-	//Clear current connections
-	for (int PanelIdx = data.ConnectedPanels.Num() - 1; PanelIdx >= 0; --PanelIdx)
+void UNoxelContainer::DisconnectAdjacentPanels(FPanelData& data)
+{
+	for (int32 OtherPanelIndex : data.ConnectedPanels) //This is the PanelIndex, not the index of the panel in the Panels array
 	{
-		int32 OtherPanelIndex = data.ConnectedPanels[PanelIdx]; //This is the PanelIndex, not the index of the panel in the Panels array
 		int32 OtherIdx;
-		GetIndexOfPanelByPanelIndex(OtherPanelIndex, OtherIdx);
-		Panels[OtherIdx].ConnectedPanels.Remove(data.PanelIndex);
-		data.ConnectedPanels.Remove(Panels[OtherIdx].PanelIndex);
-		//UE_LOG(NoxelData, Log, TEXT("[UNoxelContainer::GetAdjacentPanelsFromNodes] Removing connection between panels %i and %i"), data.PanelIndex, OtherPanelIndex);
+		if (GetIndexOfPanelByPanelIndex(OtherPanelIndex, OtherIdx))
+		{
+			Panels[OtherIdx].ConnectedPanels.Remove(data.PanelIndex);
+			MarkPanelModified(OtherPanelIndex);
+		}
 	}
+	data.ConnectedPanels.Empty();
+}
 
-	//Make new connections
-	for (int32 PanelIdx = 0; PanelIdx < AdjacentPanels.Num(); PanelIdx++) //index of the arrays AdjacentPanels, OccurencesTArray and NodesAttachedBy
+void UNoxelContainer::ConnectAdjacentPanels(FPanelData& data)
+{
+	DisconnectAdjacentPanels(data);
+	LinkAdjacentPanels(data);
+}
+
+void UNoxelContainer::LinkAdjacentPanels(FPanelData& data)
+{
+	const int32 NumNodes = data.Nodes.Num();
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
 	{
-		if (Occurrences[PanelIdx] == 2)
+		const TArray<int32>* EdgePanels = EdgeToPanels.Find(FNodeEdge(data.Nodes[NodeIdx], data.Nodes[(NodeIdx + 1) % NumNodes]));
+		if (!EdgePanels)
+		{
+			continue;
+		}
+		for (int32 OtherPanelIndex : *EdgePanels)
 		{
-			int32 OtherPanelIndex = AdjacentPanels[PanelIdx]; //This is the PanelIndex, not the index of the panel in the Panels array
 			int32 OtherIdx;
-			GetIndexOfPanelByPanelIndex(OtherPanelIndex, OtherIdx);
-			const int32 NumNodesOther = Panels[OtherIdx].Nodes.Num();
-			FNodeID Node0 = NodesAttachedBy[PanelIdx][0];
-			FNodeID Node1 = NodesAttachedBy[PanelIdx][1];
-			const int32 Node0IdxOther = Panels[OtherIdx].Nodes.Find(Node0);
-			const int32 Node1IdxOther = Panels[OtherIdx].Nodes.Find(Node1);
-			const int32 Node0Idx = data.Nodes.Find(Node0);
-			const int32 Node1Idx = data.Nodes.Find(Node1);
-			const int32 AbsDeltaOtherNodes = abs(Node0IdxOther - Node1IdxOther); //Either 1 or NumNodesOther-1 if adjacent
-			const int32 AbsDeltaNodes = abs(Node0Idx - Node1Idx); //Either 1 or NumNode-1 if adjacent
-			const bool OtherAdjacent = (AbsDeltaOtherNodes == 1) || (AbsDeltaOtherNodes == (NumNodesOther - 1));
-			const bool Adjacent = (AbsDeltaNodes == 1) || (AbsDeltaNodes == (NumNodes - 1));
-			if (Adjacent && OtherAdjacent) //Panels share an edge
+			if (OtherPanelIndex != data.PanelIndex && GetIndexOfPanelByPanelIndex(OtherPanelIndex, OtherIdx)) //Panels share an edge
 			{
-				//UE_LOG(NoxelData, Log, TEXT("[UNoxelContainer::GetAdjacentPanelsFromNodes] Panel %i shares an edge with another panel %i"), data.PanelIndex, OtherPanelIndex);
 				Panels[OtherIdx].ConnectedPanels.AddUnique(data.PanelIndex);
-				data.ConnectedPanels.AddUnique(Panels[OtherIdx].PanelIndex);
+				data.ConnectedPanels.AddUnique(OtherPanelIndex);
+				MarkPanelModified(OtherPanelIndex);
+			}
+		}
+	}
+}
+
+void UNoxelContainer::GetSideAdjacency(const FPanelData& data, FNoxelRendererPanelData& OutRendererData) const
+{
+	FNoxelRendererPanelIndexArray& OutSidePanels = OutRendererData.SideAdjacentPanels;
+	FNoxelRendererSideOffsetArray& OutSideOffsets = OutRendererData.SideAdjacencyOffsets;
+	const int32 NumNodes = data.Nodes.Num();
+	OutSidePanels.Reset();
+	OutSideOffsets.Reset(NumNodes + 1);
+	OutSideOffsets.Add(0);
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		const TArray<int32>* EdgePanels = EdgeToPanels.Find(FNodeEdge(data.Nodes[NodeIdx], data.Nodes[(NodeIdx + 1) % NumNodes]));
+		if (EdgePanels)
+		{
+			for (int32 OtherPanelIndex : *EdgePanels)
+			{
+				if (OtherPanelIndex != data.PanelIndex)
+				{
+					OutSidePanels.Add(OtherPanelIndex);
+				}
 			}
 		}
+		OutSideOffsets.Add(OutSidePanels.Num());
 	}
 }
 
@@ -310,15 +408,17 @@ bool UNoxelContainer::ReservePanelIndices(TArray<int32> IndicesToReserve)
 
 bool UNoxelContainer::AddPanelDiffered(int32 Index)
 {
-	FPanelData found;
-	if (GetPanelByPanelIndex(Index, found))
+	int32 IndexInArray;
+	if (GetIndexOfPanelByPanelIndex(Index, IndexInArray))
 	{
 		return false;
 	}
 	FPanelData Data;
 	Data.PanelIndex = Index;
-	Panels.Add(Data);
-	DifferedPanels.AddUnique(Index);
+	IndexInArray = Panels.Add(Data);
+	PanelIndexToArrayIndex.Add(Index, IndexInArray);
+	MarkPanelModified(Index);
+	DifferedPanels.Add(Index);
 	ReservedIndices.RemoveSwap(Index);
 	return true;
 }
@@ -330,15 +430,16 @@ bool UNoxelContainer::FinishAddPanel(int32 Index)
 	if (found)
 	{
 		FPanelData &data = Panels[IndexInArray];
-		TArray<int32> AdjacentPanels, Occurrences;
-		TArray<TArray<FNodeID>> NodesAttachedBy;
-		if(!IsPanelValid(data, AdjacentPanels, Occurrences, NodesAttachedBy))
+		MarkPanelDiffered(data);
+		if(!IsPanelValid(data))
 		{
 			return false;
 		}
 
 		ComputePanelGeometricData(data);
-		GetAdjacentPanelsFromNodes(data, AdjacentPanels, Occurrences, NodesAttachedBy);
+		MarkPanelModified(Index);
+		RegisterPanelEdges(data);
+		ConnectAdjacentPanels(data);
 		DifferedPanels.Remove(Index);
 		return true;
 	}
@@ -349,6 +450,11 @@ bool UNoxelContainer::ConnectNodeDiffered(int32 Index, FNodeID Node)
 {
 	if (Node.Object)
 	{
+		if (!UNodesContainer::ResolveNode(Node)) //Panels only keep ids with a handle
+		{
+			UE_LOG(NoxelData, Warning, TEXT("[UNoxelContainer::ConnectNodeDiffered] Node doesn't exist"));
+			return false;
+		}
 		UNoxelContainer* AttachedNoxel = Node.Object->GetAttachedNoxel();
 		if (AttachedNoxel != this && AttachedNoxel) //If the node is attached to another valid container
 		{
@@ -369,8 +475,9 @@ bool UNoxelContainer::ConnectNodeDiffered(int32 Index, FNodeID Node)
 		if (modified)
 		{
 			FPanelData &data = Panels[IndexInArray];
-            data.Nodes.Add(Node);
-            DifferedPanels.AddUnique(Index);
+			MarkPanelDiffered(data);
+			MarkPanelModified(Index);
+			data.Nodes.Add(Node);
 			return true;
 		}
 		return false;
@@ -382,14 +489,15 @@ bool UNoxelContainer::DisconnectNodeDiffered(int32 Index, FNodeID Node)
 {
 	int32 IndexInArray;
 	bool found = GetIndexOfPanelByPanelIndex(Index, IndexInArray);
-	if (found && Node.Object)
+	if (found && UNodesContainer::ResolveNode(Node))
 	{
 		bool modified = Node.Object->DetachNode(Node, FPanelID(this, Index)); //Detach nodes
 		if (modified)
 		{
 			FPanelData &data = Panels[IndexInArray];
+			MarkPanelDiffered(data);
+			MarkPanelModified(Index);
 			data.Nodes.Remove(Node);
-			DifferedPanels.AddUnique(Index);
 			return true;
 		}
 		return false;
@@ -408,6 +516,7 @@ bool UNoxelContainer::SetPanelPropertiesDiffered(int32 Index, float ThicknessNor
 		data.ThicknessNormal = ThicknessNormal;
 		data.ThicknessAntiNormal = ThicknessAntiNormal;
 		data.Virtual = Virtual;
+		MarkPanelModified(Index);
 	}
 	return found;
 }
@@ -421,15 +530,11 @@ bool UNoxelContainer::RemovePanelDiffered(int32 Index)
 		FPanelData &data = Panels[IndexInArray];
 		if (data.Nodes.Num() == 0)
 		{
-			TArray<int32> AdjacentPanels, Occurrences;
-         	TArray<TArray<FNodeID>> NodesAttachedBy;
-         	TArray<int32> IgnoreFilter;
-         	IgnoreFilter.Add(data.PanelIndex);
-         	FindPanelsByNodes(data.Nodes, AdjacentPanels, Occurrences, NodesAttachedBy, IgnoreFilter);
-         	GetAdjacentPanelsFromNodes(data, AdjacentPanels, Occurrences, NodesAttachedBy); //remove connected
+			DisconnectAdjacentPanels(data);
+			MarkPanelModified(Index);
 			
 			UnusedIndices.Add(Index);
-			Panels.RemoveAt(IndexInArray);
+			RemovePanelAt(IndexInArray);
 			DifferedPanels.Remove(Index);
 			
 			return true;
@@ -474,6 +579,81 @@ bool UNoxelContainer::AddPanel(FPanelData data)
 	return false;
 }
 
+int32 UNoxelContainer::AddPanels(TArrayView<FPanelData> InPanels)
+{
+	//Nodes are connected and panels validated one at a time, as each panel is checked against the ones added before it
+	TArray<int32> AddedPanelIndices;
+	AddedPanelIndices.Reserve(InPanels.Num());
+	Panels.Reserve(Panels.Num() + InPanels.Num());
+	for (FPanelData& data : InPanels)
+	{
+		data.PanelIndex = GetNewPanelIndex();
+		if (!AddPanelDiffered(data.PanelIndex) || !SetPanelPropertiesDiffered(data.PanelIndex, data.ThicknessNormal, data.ThicknessAntiNormal, data.Virtual))
+		{
+			data.PanelIndex = INDEX_NONE;
+			continue;
+		}
+		bool valid = true; int i;
+		const int32 NumNodes = data.Nodes.Num();
+		for (i = 0; i < NumNodes; ++i)
+		{
+			if (!ConnectNodeDiffered(data.PanelIndex, data.Nodes[i]))
+			{
+				valid = false;
+				break;
+			}
+		}
+		if (valid)
+		{
+			int32 IndexInArray;
+			valid = GetIndexOfPanelByPanelIndex(data.PanelIndex, IndexInArray) && IsPanelValid(Panels[IndexInArray]);
+		}
+		if (!valid)
+		{
+			for (int j = i - 1; j >= 0; --j)
+			{
+				DisconnectNodeDiffered(data.PanelIndex, data.Nodes[j]);
+			}
+			RemovePanelDiffered(data.PanelIndex);
+			data.PanelIndex = INDEX_NONE;
+			continue;
+		}
+		AddedPanelIndices.Add(data.PanelIndex);
+	}
+
+	//Plane fit, node order and area only depend on the panel's own nodes
+	//Node locations are read from the nodes containers here, the workers only see plain positions
+	const int32 NumAdded = AddedPanelIndices.Num();
+	TArray<int32> AddedIndicesInArray;
+	AddedIndicesInArray.Reserve(NumAdded);
+	TArray<TArray<FVector>> AddedNodeLocations;
+	AddedNodeLocations.SetNum(NumAdded);
+	for (int32 AddedIdx = 0; AddedIdx < NumAdded; AddedIdx++)
+	{
+		const int32 IndexInArray = PanelIndexToArrayIndex[AddedPanelIndices[AddedIdx]];
+		AddedIndicesInArray.Add(IndexInArray);
+		GetPanelNodeLocations(Panels[IndexInArray], AddedNodeLocations[AddedIdx]);
+	}
+	ParallelFor(NumAdded, [&](int32 AddedIdx)
+	{
+		ComputePanelGeometricData(Panels[AddedIndicesInArray[AddedIdx]], AddedNodeLocations[AddedIdx]);
+	}, NumAdded < PANEL_GEOMETRY_PARALLEL_MIN_PANELS);
+
+	//Once every side is in the edge table, each panel only has to link itself to the panels sharing its sides
+	for (int32 IndexInArray : AddedIndicesInArray)
+	{
+		RegisterPanelEdges(Panels[IndexInArray]);
+	}
+	for (int32 IndexInArray : AddedIndicesInArray)
+	{
+		FPanelData& data = Panels[IndexInArray];
+		LinkAdjacentPanels(data);
+		MarkPanelModified(data.PanelIndex);
+		DifferedPanels.Remove(data.PanelIndex);
+	}
+	return NumAdded;
+}
+
 bool UNoxelContainer::RemovePanel(int32 index)
 {
 	int32 IndexInArray;
@@ -510,14 +690,15 @@ bool UNoxelContainer::GetPanelByNodes(TArray<FNodeID> Nodes, int32 & PanelIndex)
 	TSet<int32> CommonPanelIndices;
 	if (Nodes.Num() >= 3)
 	{
-		if (!Nodes[0].IsValid())
+		//Ids may come from blueprints, made from a location
+		if (!UNodesContainer::ResolveNode(Nodes[0]))
 		{
 			return false;
 		}
-		CommonPanelIndices = TSet<int32>(Nodes[0].Object->GetAttachedPanels(Nodes[0].Location));
+		CommonPanelIndices.Append(Nodes[0].Object->GetAttachedPanels(Nodes[0]));
 		for (int32 i = 1; i < Nodes.Num(); i++)
 		{
-			if (!Nodes[i].IsValid())
+			if (!UNodesContainer::ResolveNode(Nodes[i]))
 			{
 				return false;
 			}
@@ -525,7 +706,14 @@ bool UNoxelContainer::GetPanelByNodes(TArray<FNodeID> Nodes, int32 & PanelIndex)
 			{
 				return false;
 			}
-			CommonPanelIndices = CommonPanelIndices.Intersect(TSet<int32>(Nodes[i].Object->GetAttachedPanels(Nodes[i].Location)));
+			const TArrayView<const int32> AttachedPanels = Nodes[i].Object->GetAttachedPanels(Nodes[i]);
+			for (auto It = CommonPanelIndices.CreateIterator(); It; ++It)
+			{
+				if (!AttachedPanels.Contains(*It))
+				{
+					It.RemoveCurrent();
+				}
+			}
 		}
 		for (auto PanelIdx : CommonPanelIndices)
 		{
@@ -536,7 +724,12 @@ bool UNoxelContainer::GetPanelByNodes(TArray<FNodeID> Nodes, int32 & PanelIndex)
 	return false;
 }
 
-TArray<FPanelData> UNoxelContainer::GetPanels() const
+const TArray<FPanelData>& UNoxelContainer::GetPanels() const
+{
+	return Panels;
+}
+
+TArray<FPanelData> UNoxelContainer::K2_GetPanels() const
 {
 	return Panels;
 }
@@ -555,6 +748,20 @@ bool UNoxelContainer::GetPanelHit(FHitResult hit, FPanelID& PanelHit)
 	return false;
 }
 
+SIZE_T UNoxelContainer::GetPanelsAllocatedSize() const
+{
+	SIZE_T Size = Panels.GetAllocatedSize() + PanelIndexToArrayIndex.GetAllocatedSize() + EdgeToPanels.GetAllocatedSize();
+	for (const FPanelData& Panel : Panels)
+	{
+		Size += Panel.Nodes.GetAllocatedSize() + Panel.ConnectedPanels.GetAllocatedSize(); //Zero unless the panel outgrew its inline storage
+	}
+	for (const TPair<FNodeEdge, TArray<int32>>& Edge : EdgeToPanels)
+	{
+		Size += Edge.Value.GetAllocatedSize();
+	}
+	return Size;
+}
+
 TArray<UNodesContainer*> UNoxelContainer::GetConnectedNodesContainers()
 {
 	return ConnectedNodesContainers;
@@ -562,9 +769,9 @@ TArray<UNodesContainer*> UNoxelContainer::GetConnectedNodesContainers()
 
 void UNoxelContainer::Empty()
 {
-	for (FPanelData panel : Panels)
+	for (const FPanelData& panel : Panels)
 	{
-		for (FNodeID node : panel.Nodes)
+		for (const FNodeID& node : panel.Nodes)
 		{
 			if (node.Object)
 			{
@@ -573,49 +780,184 @@ void UNoxelContainer::Empty()
 		}
 	}
 	Panels.Empty();
+	PanelIndexToArrayIndex.Empty();
+	EdgeToPanels.Empty();
 	UnusedIndices.Empty();
 	ConnectedNodesContainers.Empty();
+	ExportedNodesContainersTransforms.Empty();
 	MaxIndex = INT32_MIN;
+	bProviderDataDirty = true;
+}
+
+void UNoxelContainer::MarkPanelModified(int32 PanelIndex)
+{
+	ModifiedPanels.Add(PanelIndex);
+}
+
+bool UNoxelContainer::UpdateNodesContainersTransforms()
+{
+	bool bMoved = false;
+	//Containers that were disconnected or destroyed would otherwise stay as stale keys
+	for (auto It = ExportedNodesContainersTransforms.CreateIterator(); It; ++It)
+	{
+		if (!It->Key.IsValid() || !ConnectedNodesContainers.Contains(It->Key.Get()))
+		{
+			It.RemoveCurrent();
+		}
+	}
+	for (UNodesContainer* NodesContainer : ConnectedNodesContainers)
+	{
+		if (!IsValid(NodesContainer))
+		{
+			continue;
+		}
+		const FTransform RelativeTransform = NodesContainer->GetComponentTransform().GetRelativeTransform(GetComponentTransform());
+		FTransform* ExportedTransform = ExportedNodesContainersTransforms.Find(NodesContainer);
+		if (ExportedTransform)
+		{
+			bMoved |= !ExportedTransform->Equals(RelativeTransform);
+			*ExportedTransform = RelativeTransform;
+		}
+		else
+		{
+			ExportedNodesContainersTransforms.Add(NodesContainer, RelativeTransform);
+		}
+	}
+	return bMoved;
 }
 
 void UNoxelContainer::UpdateProviderData()
 {
-	TArray<FVector> NodeData;
-	TArray<FNoxelRendererPanelData> PanelsData;
-	PanelsData.Reserve(Panels.Num());
-	TMap<FNodeID, int32> NodeRedirectorMap;
-	TMap<int32, int32> PanelRedirectorMap;
-	for (FPanelData Panel : Panels)
+	//Node locations are only sent when a node is first used, so everything has to be sent again if a nodes container moved
+	if (UpdateNodesContainersTransforms() || bProviderDataDirty)
 	{
-		TArray<int32> Nodes;
-		for (FNodeID Node : Panel.Nodes)
+		ExportedNodes.Empty();
+		ExportedNodesRefCount.Empty();
+		ExportedNodeIndices.Empty();
+		ExportedPanelNodes.Empty();
+		ModifiedPanels.Empty(Panels.Num());
+		for (const FPanelData& Panel : Panels)
+		{
+			ModifiedPanels.Add(Panel.PanelIndex);
+		}
+	}
+	else if (ModifiedPanels.Num() == 0)
+	{
+		return;
+	}
+	bProviderDataDirty = false;
+
+	//Release the nodes used by the exported version of the modified panels
+	TArray<int32> FreedNodes;
+	for (int32 PanelIndex : ModifiedPanels)
+	{
+		FPanelNodesArray OldNodes;
+		if (ExportedPanelNodes.RemoveAndCopyValue(PanelIndex, OldNodes))
+		{
+			for (const FNodeID& Node : OldNodes)
+			{
+				const int32 NodeIdx = ExportedNodeIndices[Node];
+				if (--ExportedNodesRefCount[NodeIdx] == 0)
+				{
+					FreedNodes.Add(NodeIdx);
+				}
+			}
+		}
+	}
+
+	//Use the nodes of the current version, new nodes are added at the end
+	TSet<int32> DirtyNodes;
+	for (int32 PanelIndex : ModifiedPanels)
+	{
+		int32 IndexInArray;
+		if (!GetIndexOfPanelByPanelIndex(PanelIndex, IndexInArray)) //Panel was removed
+		{
+			continue;
+		}
+		const FPanelNodesArray& PanelNodes = Panels[IndexInArray].Nodes;
+		for (const FNodeID& Node : PanelNodes)
 		{
-			int32* NodeIdxPtr = NodeRedirectorMap.Find(Node);
+			int32* NodeIdxPtr = ExportedNodeIndices.Find(Node);
 			if (NodeIdxPtr != nullptr)
 			{
-				Nodes.Add(*NodeIdxPtr);
+				ExportedNodesRefCount[*NodeIdxPtr]++;
 			}
 			else
 			{
-				int32 NodeIdx = NodeData.Add(GetComponentTransform().InverseTransformPosition(Node.ToWorld())); //Go to world then back to this container's location
-				NodeRedirectorMap.Add(Node, NodeIdx);
-				Nodes.Add(NodeIdx);
+				const int32 NodeIdx = ExportedNodes.Add(Node);
+				ExportedNodesRefCount.Add(1);
+				ExportedNodeIndices.Add(Node, NodeIdx);
+				DirtyNodes.Add(NodeIdx);
 			}
 		}
-		FNoxelRendererPanelData PanelData(Panel.PanelIndex, Nodes, Panel.ThicknessNormal, Panel.ThicknessAntiNormal, Panel.Area, Panel.Normal, Panel.Center, Panel.ConnectedPanels);
-		int32 PanelIdx = PanelsData.Add(PanelData);
-		PanelRedirectorMap.Add(Panel.PanelIndex, PanelIdx);
+		ExportedPanelNodes.Add(PanelIndex, PanelNodes);
+	}
+
+	//Fill the holes left by the unused nodes with the last nodes, going backwards so that the last node is always in use
+	FreedNodes.Sort(TGreater<int32>());
+	for (int32 NodeIdx : FreedNodes)
+	{
+		if (ExportedNodesRefCount[NodeIdx] != 0) //Used again by a modified panel
+		{
+			continue;
+		}
+		ExportedNodeIndices.Remove(ExportedNodes[NodeIdx]);
+		const int32 LastNodeIdx = ExportedNodes.Num() - 1;
+		if (NodeIdx != LastNodeIdx)
+		{
+			const FNodeID MovedNode = ExportedNodes[LastNodeIdx];
+			ExportedNodes[NodeIdx] = MovedNode;
+			ExportedNodesRefCount[NodeIdx] = ExportedNodesRefCount[LastNodeIdx];
+			ExportedNodeIndices[MovedNode] = NodeIdx;
+			DirtyNodes.Add(NodeIdx);
+			//The panels using the moved node have to point to its new index
+			ModifiedPanels.Append(MovedNode.Object->GetAttachedPanels(MovedNode));
+		}
+		ExportedNodes.Pop(false);
+		ExportedNodesRefCount.Pop(false);
+	}
+
+	FNoxelRendererDelta Delta;
+	Delta.NumNodes = ExportedNodes.Num();
+	Delta.Nodes.Reserve(DirtyNodes.Num());
+	for (int32 NodeIdx : DirtyNodes)
+	{
+		if (NodeIdx < Delta.NumNodes)
+		{
+			Delta.Nodes.Emplace(NodeIdx, GetComponentTransform().InverseTransformPosition(ExportedNodes[NodeIdx].ToWorld())); //Go to world then back to this container's location
+		}
 	}
-	for (int32 PanelIdx = 0; PanelIdx < PanelsData.Num(); PanelIdx++) //Convert from PanelIndex to index in the array
+	//The provider's panels array follows the layout of Panels, AdjacentPanels are converted from PanelIndex to index in the array
+	Delta.NumPanels = Panels.Num();
+	Delta.Panels.Reserve(ModifiedPanels.Num());
+	for (int32 PanelIndex : ModifiedPanels)
 	{
-		FNoxelRendererPanelData& Panel = PanelsData[PanelIdx];
-		for (int32 i = 0; i < Panel.AdjacentPanels.Num(); i++)
+		int32 IndexInArray;
+		if (!GetIndexOfPanelByPanelIndex(PanelIndex, IndexInArray))
+		{
+			continue;
+		}
+		const FPanelData& Panel = Panels[IndexInArray];
+		TArray<int32> Nodes;
+		Nodes.Reserve(Panel.Nodes.Num());
+		for (const FNodeID& Node : Panel.Nodes)
+		{
+			Nodes.Add(ExportedNodeIndices[Node]);
+		}
+		FNoxelRendererPanelData PanelData(Panel.PanelIndex, Nodes, Panel.ThicknessNormal, Panel.ThicknessAntiNormal, Panel.Area, Panel.Normal, Panel.Center, Panel.ConnectedPanels);
+		GetSideAdjacency(Panel, PanelData);
+		for (int32& AdjacentPanel : PanelData.AdjacentPanels)
+		{
+			AdjacentPanel = PanelIndexToArrayIndex[AdjacentPanel];
+		}
+		for (int32& AdjacentPanel : PanelData.SideAdjacentPanels)
 		{
-			Panel.AdjacentPanels[i] = PanelRedirectorMap[Panel.AdjacentPanels[i]];
+			AdjacentPanel = PanelIndexToArrayIndex[AdjacentPanel];
 		}
+		Delta.Panels.Emplace(IndexInArray, MoveTemp(PanelData));
 	}
-	NoxelProvider->SetNodes(NodeData);
-	NoxelProvider->SetPanels(PanelsData);
+	ModifiedPanels.Reset();
+	NoxelProvider->ApplyDelta(Delta);
 }
 
 /*UBodySetup* UNoxelContainer::GetBodySetup()
@@ -651,7 +993,7 @@ bool UNoxelContainer::IsConnected()
 
 bool UNoxelContainer::CheckDataValidity()
 {
-	TArray<int32> diffcopy(DifferedPanels);
+	TArray<int32> diffcopy = DifferedPanels.Array();
 	for (int32 PanelIdx : diffcopy)
 	{
 		if (!FinishAddPanel(PanelIdx))
@@ -3,6 +3,7 @@
 #include "Noxel/NoxelDataComponent.h"
 #include "Net/UnrealNetwork.h"
 #include "Noxel/CraftDataHandler.h"
+#include "Noxel/NoxelMeshUpdateSubsystem.h"
 
 UNoxelDataComponent::UNoxelDataComponent()
 	:Super()
@@ -32,6 +33,11 @@ ECraftSpawnContext UNoxelDataComponent::GetSpawnContext()
 	return SpawnContext;
 }
 
+bool UNoxelDataComponent::IsCollisionOnly() const
+{
+	return GetNetMode() == NM_DedicatedServer;
+}
+
 bool UNoxelDataComponent::IsConnected()
 {
 	return false;
@@ -45,3 +51,17 @@ bool UNoxelDataComponent::CheckDataValidity()
 void UNoxelDataComponent::UpdateMesh()
 {
 }
+
+void UNoxelDataComponent::QueueMeshUpdate()
+{
+	UWorld* World = GetWorld();
+	UNoxelMeshUpdateSubsystem* MeshUpdateSubsystem = World ? World->GetSubsystem<UNoxelMeshUpdateSubsystem>() : nullptr;
+	if (MeshUpdateSubsystem)
+	{
+		MeshUpdateSubsystem->MarkDirty(this);
+	}
+	else
+	{
+		UpdateMesh();
+	}
+}
@@ -10,7 +10,9 @@ FNodeID FNodeID::FromWorld(UNodesContainer* InObject, FVector WorldLocation)
 	{
 		return FNodeID();
 	}
-	return FNodeID(InObject, InObject->GetComponentTransform().InverseTransformPosition(WorldLocation));
+	FNodeID Node(InObject, InObject->GetComponentTransform().InverseTransformPosition(WorldLocation));
+	InObject->FindNode(Node.Location, Node); //Gets the handle if the node exists
+	return Node;
 }
 
 FVector FNodeID::ToWorld() const
@@ -25,5 +27,5 @@ bool FNodeID::IsValid() const
 
 FString FNodeID::ToString() const
 {
-	return FString::Printf(TEXT("Object Name = %s; Location = %s"), *(Object->GetName()), *Location.ToString());
+	return FString::Printf(TEXT("Object Name = %s; Location = %s; Handle = %d:%d"), *(Object->GetName()), *Location.ToString(), Handle.Slot, Handle.Generation);
 }
@@ -157,6 +157,38 @@ bool UNoxelLibrary::getClosestPointOnTwoLines(FVector Line1Point, FVector Line1D
 	return false;
 }
 
+/////Data
+
+TArray<FNodeID> UNoxelLibrary::GetPanelNodes(const FPanelData& Panel)
+{
+	return TArray<FNodeID>(Panel.Nodes);
+}
+
+void UNoxelLibrary::SetPanelNodes(FPanelData& Panel, const TArray<FNodeID>& InNodes)
+{
+	Panel.Nodes = InNodes;
+}
+
+TArray<int32> UNoxelLibrary::GetPanelConnectedPanels(const FPanelData& Panel)
+{
+	return TArray<int32>(Panel.ConnectedPanels);
+}
+
+void UNoxelLibrary::SetPanelConnectedPanels(FPanelData& Panel, const TArray<int32>& InConnectedPanels)
+{
+	Panel.ConnectedPanels = InConnectedPanels;
+}
+
+TArray<int32> UNoxelLibrary::GetNodeConnectedPanels(const FNodeData& Node)
+{
+	return TArray<int32>(Node.ConnectedPanels);
+}
+
+void UNoxelLibrary::SetNodeConnectedPanels(FNodeData& Node, const TArray<int32>& InConnectedPanels)
+{
+	Node.ConnectedPanels = InConnectedPanels;
+}
+
 /////Raycast
 
 FCollisionQueryParams UNoxelLibrary::getCollisionParameters()
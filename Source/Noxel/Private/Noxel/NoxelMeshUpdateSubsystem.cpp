@@ -0,0 +1,86 @@
+//Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+#include "Noxel/NoxelMeshUpdateSubsystem.h"
+#include "Noxel.h"
+#include "Noxel/NoxelDataComponent.h"
+
+UNoxelMeshUpdateSubsystem::UNoxelMeshUpdateSubsystem()
+	: Super()
+{
+	FrameBudgetMs = 0.f;
+}
+
+void UNoxelMeshUpdateSubsystem::Deinitialize()
+{
+	DirtyComponents.Empty();
+	DirtyComponentsSet.Empty();
+	Super::Deinitialize();
+}
+
+void UNoxelMeshUpdateSubsystem::MarkDirty(UNoxelDataComponent* Component)
+{
+	if (!Component)
+	{
+		return;
+	}
+	bool bAlreadyQueued;
+	DirtyComponentsSet.Add(Component, &bAlreadyQueued);
+	if (!bAlreadyQueued)
+	{
+		DirtyComponents.Add(Component);
+	}
+}
+
+void UNoxelMeshUpdateSubsystem::Flush(double BudgetSeconds)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	//Components queued again by an update wait for the next flush, so that an update that keeps queuing can't loop forever
+	const int32 NumToUpdate = DirtyComponents.Num();
+	int32 NumUpdated = 0;
+	while (NumUpdated < NumToUpdate)
+	{
+		TWeakObjectPtr<UNoxelDataComponent> Component = DirtyComponents[NumUpdated];
+		NumUpdated++;
+		//Removed before updating so that the update can queue the component again
+		DirtyComponentsSet.Remove(Component);
+		if (Component.IsValid())
+		{
+			Component->UpdateMesh();
+		}
+		if (BudgetSeconds > 0.0 && FPlatformTime::Seconds() - StartTime > BudgetSeconds)
+		{
+			break;
+		}
+	}
+	DirtyComponents.RemoveAt(0, NumUpdated);
+}
+
+void UNoxelMeshUpdateSubsystem::Tick(float DeltaTime)
+{
+	Flush(FrameBudgetMs / 1000.0);
+}
+
+ETickableTickType UNoxelMeshUpdateSubsystem::GetTickableTickType() const
+{
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UNoxelMeshUpdateSubsystem::IsTickable() const
+{
+	return DirtyComponents.Num() != 0;
+}
+
+bool UNoxelMeshUpdateSubsystem::IsTickableInEditor() const
+{
+	return true;
+}
+
+UWorld* UNoxelMeshUpdateSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+TStatId UNoxelMeshUpdateSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UNoxelMeshUpdateSubsystem, STATGROUP_Tickables);
+}
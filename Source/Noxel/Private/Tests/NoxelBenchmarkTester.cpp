@@ -0,0 +1,614 @@
+// Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+
+#include "Tests/NoxelBenchmarkTester.h"
+
+#include "Noxel.h"
+#include "Noxel/NodesContainer.h"
+#include "Noxel/NoxelContainer.h"
+#include "Noxel/NoxelDataStructs.h"
+#include "NoxelRMCProvider.h"
+#include "NodesRMCProvider.h"
+#include "VoxelRMCProvider.h"
+#include "Voxel/VoxelComponent.h"
+#include "RuntimeMeshStaticMeshConverter.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+ANoxelBenchmarkTester::ANoxelBenchmarkTester()
+{
+	PanelCounts = { 500, 1000, 2000, 5000, 10000 };
+	NumSamples = 200;
+	bBenchmarkPanelInsertRemove = true;
+	bBenchmarkPanelsMemory = true;
+	bBenchmarkIntersectionBake = true;
+	NumBakeRuns = 5;
+	bBenchmarkMeshBuild = true;
+	bBenchmarkCollision = true;
+	NodeCounts = { 100, 1000, 10000 };
+	bBenchmarkNodesMemory = true;
+	VoxelCounts = { 1000, 10000, 100000 };
+	MaxFlatArrayVoxelCount = 10000;
+	bBenchmarkVoxels = true;
+	bBenchmarkVoxelTrace = true;
+	VoxelTraceTimeout = 30.f;
+	TraceVoxelComponent = nullptr;
+}
+
+void ANoxelBenchmarkTester::BeginPlay()
+{
+	Super::BeginPlay();
+	if (bBenchmarkNodesMemory)
+	{
+		BenchmarkNodesMemory();
+	}
+	if (bBenchmarkVoxels)
+	{
+		BenchmarkVoxels();
+	}
+	if (bBenchmarkVoxelTrace)
+	{
+		StartVoxelTraceBenchmark(0);
+	}
+	if (PanelCounts.Num() == 0)
+	{
+		return;
+	}
+	PanelCounts.Sort();
+	MakeGrid(PanelCounts.Last() + NumSamples);
+	if (bBenchmarkPanelInsertRemove)
+	{
+		BenchmarkPanelInsertRemove();
+	}
+	if (bBenchmarkPanelsMemory)
+	{
+		BenchmarkPanelsMemory();
+	}
+	if (bBenchmarkIntersectionBake)
+	{
+		BenchmarkIntersectionBake();
+	}
+	if (bBenchmarkMeshBuild)
+	{
+		BenchmarkMeshBuild();
+	}
+	if (bBenchmarkCollision)
+	{
+		BenchmarkCollision();
+	}
+	noxelContainer->Empty();
+}
+
+void ANoxelBenchmarkTester::MakeGrid(int32 NumPanels)
+{
+	const float Spacing = 100.f;
+	const int32 GridSize = FMath::CeilToInt(FMath::Sqrt(NumPanels / 2.f));
+	GridPanelNodes.Empty(GridSize * GridSize * 6);
+	for (int32 Y = 0; Y <= GridSize; ++Y)
+	{
+		for (int32 X = 0; X <= GridSize; ++X)
+		{
+			nodesContainer->AddNode(FVector(X, Y, 0) * Spacing);
+		}
+	}
+	//Ids of the grid nodes, with the handles they are keyed on
+	auto GridNode = [&](int32 X, int32 Y)
+	{
+		FNodeID Node;
+		nodesContainer->FindNode(FVector(X, Y, 0) * Spacing, Node);
+		return Node;
+	};
+	for (int32 Y = 0; Y < GridSize; ++Y)
+	{
+		for (int32 X = 0; X < GridSize; ++X)
+		{
+			const FNodeID A = GridNode(X, Y), B = GridNode(X + 1, Y), C = GridNode(X + 1, Y + 1), D = GridNode(X, Y + 1);
+			GridPanelNodes.Append({ A, B, C });
+			GridPanelNodes.Append({ A, C, D });
+		}
+	}
+}
+
+void ANoxelBenchmarkTester::FillToPanelCount(int32 NumPanels)
+{
+	for (int32 PanelIdx = noxelContainer->GetPanels().Num(); PanelIdx < NumPanels; ++PanelIdx)
+	{
+		noxelContainer->AddPanel(FPanelData({ GridPanelNodes[3 * PanelIdx], GridPanelNodes[3 * PanelIdx + 1], GridPanelNodes[3 * PanelIdx + 2] }, 10));
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkPanelInsertRemove()
+{
+	noxelContainer->Empty();
+	for (int32 NumPanels : PanelCounts)
+	{
+		FillToPanelCount(NumPanels);
+
+		const double InsertStart = FPlatformTime::Seconds();
+		FillToPanelCount(NumPanels + NumSamples);
+		const double InsertTime = FPlatformTime::Seconds() - InsertStart;
+
+		TArray<int32> SampledIndices;
+		for (int32 PanelIdx = NumPanels; PanelIdx < NumPanels + NumSamples; ++PanelIdx)
+		{
+			int32 PanelIndex;
+			if (noxelContainer->GetPanelByNodes({ GridPanelNodes[3 * PanelIdx], GridPanelNodes[3 * PanelIdx + 1], GridPanelNodes[3 * PanelIdx + 2] }, PanelIndex))
+			{
+				SampledIndices.Add(PanelIndex);
+			}
+		}
+
+		const double RemoveStart = FPlatformTime::Seconds();
+		for (int32 PanelIndex : SampledIndices)
+		{
+			noxelContainer->RemovePanel(PanelIndex);
+		}
+		const double RemoveTime = FPlatformTime::Seconds() - RemoveStart;
+
+		//Same panels again, added in a single batch
+		TArray<FPanelData> BatchPanels;
+		BatchPanels.Reserve(NumSamples);
+		for (int32 PanelIdx = NumPanels; PanelIdx < NumPanels + NumSamples; ++PanelIdx)
+		{
+			BatchPanels.Add(FPanelData({ GridPanelNodes[3 * PanelIdx], GridPanelNodes[3 * PanelIdx + 1], GridPanelNodes[3 * PanelIdx + 2] }, 10));
+		}
+		const double BatchInsertStart = FPlatformTime::Seconds();
+		noxelContainer->AddPanels(BatchPanels);
+		const double BatchInsertTime = FPlatformTime::Seconds() - BatchInsertStart;
+		for (const FPanelData& BatchPanel : BatchPanels)
+		{
+			if (BatchPanel.PanelIndex != INDEX_NONE)
+			{
+				noxelContainer->RemovePanel(BatchPanel.PanelIndex);
+			}
+		}
+
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkPanelInsertRemove] %d panels : insert %.2f us/panel, batch insert %.2f us/panel, remove %.2f us/panel"),
+			NumPanels, InsertTime * 1e6 / NumSamples, BatchInsertTime * 1e6 / NumSamples, RemoveTime * 1e6 / FMath::Max(SampledIndices.Num(), 1));
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkPanelsMemory()
+{
+	noxelContainer->Empty();
+	for (int32 NumPanels : PanelCounts)
+	{
+		FillToPanelCount(NumPanels);
+		const int32 NumNodes = FMath::Max(nodesContainer->GenerateNodesKeyArray().Num(), 1);
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkPanelsMemory] %d panels : %.1f bytes/panel (sizeof(FPanelData) %d), %.1f bytes/node (sizeof(FNodeData) %d)"),
+			NumPanels, (double)noxelContainer->GetPanelsAllocatedSize() / NumPanels, (int32)sizeof(FPanelData),
+			(double)nodesContainer->GetNodesAllocatedSize() / NumNodes, (int32)sizeof(FNodeData));
+		noxelContainer->UpdateMesh();
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkPanelsMemory] %d panels : %.1f bytes/provider panel (sizeof(FNoxelRendererPanelData) %d)"),
+			NumPanels, (double)noxelContainer->NoxelProvider->GetPanelsAllocatedSize() / NumPanels, (int32)sizeof(FNoxelRendererPanelData));
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkIntersectionBake()
+{
+	noxelContainer->Empty();
+	const int32 NumWorkers = FTaskGraphInterface::Get().GetNumWorkerThreads();
+	for (int32 NumPanels : PanelCounts)
+	{
+		FillToPanelCount(NumPanels);
+		noxelContainer->UpdateMesh();
+		const FNoxelRendererShapeRef ProviderShape = noxelContainer->NoxelProvider->GetShape();
+		const TArray<FVector>& ProviderNodes = ProviderShape->Nodes;
+		const TArray<FNoxelRendererPanelData>& ProviderPanels = ProviderShape->Panels;
+		TArray<int32> PanelIndices;
+		for (int32 PanelIdx = 0; PanelIdx < ProviderPanels.Num(); ++PanelIdx)
+		{
+			PanelIndices.Add(PanelIdx);
+		}
+
+		double BestTimes[2] = { DBL_MAX, DBL_MAX };
+		for (int32 Run = 0; Run < NumBakeRuns; ++Run)
+		{
+			for (int32 bParallel = 0; bParallel < 2; ++bParallel)
+			{
+				TArray<FNoxelRendererBakedIntersectionData> BakedIntersections;
+				const double BakeStart = FPlatformTime::Seconds();
+				UNoxelRMCProvider::BakeIntersections(ProviderNodes, ProviderPanels, PanelIndices, BakedIntersections, bParallel != 0);
+				BestTimes[bParallel] = FMath::Min(BestTimes[bParallel], FPlatformTime::Seconds() - BakeStart);
+			}
+		}
+
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkIntersectionBake] %d panels : single thread %.2f ms, %d workers %.2f ms, speedup x%.2f"),
+			ProviderPanels.Num(), BestTimes[0] * 1e3, NumWorkers, BestTimes[1] * 1e3, BestTimes[0] / FMath::Max(BestTimes[1], 1e-9));
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkMeshBuild()
+{
+	//Default RMC vertex layout : position, packed normal and tangent, color, half precision UV
+	const int32 VertexSize = sizeof(FVector) + 2 * sizeof(FPackedNormal) + sizeof(FColor) + sizeof(FVector2DHalf);
+	noxelContainer->Empty();
+	for (int32 NumPanels : PanelCounts)
+	{
+		FillToPanelCount(NumPanels);
+		noxelContainer->UpdateMesh();
+		const FNoxelRendererShapeRef ProviderShape = noxelContainer->NoxelProvider->GetShape();
+		const TArray<FVector>& ProviderNodes = ProviderShape->Nodes;
+		const TArray<FNoxelRendererPanelData>& ProviderPanels = ProviderShape->Panels;
+		TArray<int32> PanelIndices;
+		for (int32 PanelIdx = 0; PanelIdx < ProviderPanels.Num(); ++PanelIdx)
+		{
+			PanelIndices.Add(PanelIdx);
+		}
+		TArray<FNoxelRendererBakedIntersectionData> BakedIntersections;
+		UNoxelRMCProvider::BakeIntersections(ProviderNodes, ProviderPanels, PanelIndices, BakedIntersections);
+
+		for (int32 bShareVertices = 0; bShareVertices < 2; ++bShareVertices)
+		{
+			FRuntimeMeshRenderableMeshData MeshData;
+			const double BuildStart = FPlatformTime::Seconds();
+			UNoxelRMCProvider::BuildSectionMesh(0, ProviderNodes, ProviderPanels, BakedIntersections, MeshData, bShareVertices != 0);
+			const double BuildTime = FPlatformTime::Seconds() - BuildStart;
+			const int32 NumVertices = MeshData.Positions.Num();
+			const int32 NumIndices = MeshData.Triangles.Num();
+			const int32 IndexSize = NumVertices > (1 << 16) ? sizeof(uint32) : sizeof(uint16);
+			UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkMeshBuild] %d panels, %s vertices : %d vertices (%d KB), %d indices (%d KB), built in %.2f ms"),
+				ProviderPanels.Num(), bShareVertices ? TEXT("shared") : TEXT("unshared"), NumVertices, NumVertices * VertexSize / 1024,
+				NumIndices, NumIndices * IndexSize / 1024, BuildTime * 1e3);
+		}
+
+		double BestTimes[2] = { DBL_MAX, DBL_MAX };
+#if !UE_BUILD_SHIPPING
+		//Same mesh through TFunction callbacks and through the inlined writer
+		for (int32 Run = 0; Run < NumBakeRuns; ++Run)
+		{
+			for (int32 bTemplated = 0; bTemplated < 2; ++bTemplated)
+			{
+				FRuntimeMeshRenderableMeshData MeshData;
+				const double BuildStart = FPlatformTime::Seconds();
+				if (bTemplated)
+				{
+					UNoxelRMCProvider::BuildSectionMesh(0, ProviderNodes, ProviderPanels, BakedIntersections, MeshData, false);
+				}
+				else
+				{
+					UNoxelRMCProvider::BuildSectionMeshWithCallbacks(0, ProviderNodes, ProviderPanels, BakedIntersections, MeshData);
+				}
+				BestTimes[bTemplated] = FMath::Min(BestTimes[bTemplated], FPlatformTime::Seconds() - BuildStart);
+			}
+		}
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkMeshBuild] %d panels : callbacks %.2f ms, templated writer %.2f ms"),
+			ProviderPanels.Num(), BestTimes[0] * 1e3, BestTimes[1] * 1e3);
+#endif
+
+		//Normals written with the vertices against normals computed from the triangles afterwards
+		BestTimes[0] = BestTimes[1] = DBL_MAX;
+		for (int32 Run = 0; Run < NumBakeRuns; ++Run)
+		{
+			for (int32 bAnalyticNormals = 0; bAnalyticNormals < 2; ++bAnalyticNormals)
+			{
+				FRuntimeMeshRenderableMeshData MeshData;
+				const double BuildStart = FPlatformTime::Seconds();
+				UNoxelRMCProvider::BuildSectionMesh(0, ProviderNodes, ProviderPanels, BakedIntersections, MeshData, true, bAnalyticNormals != 0);
+				BestTimes[bAnalyticNormals] = FMath::Min(BestTimes[bAnalyticNormals], FPlatformTime::Seconds() - BuildStart);
+			}
+		}
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkMeshBuild] %d panels : normals from triangles %.2f ms, analytic normals %.2f ms"),
+			ProviderPanels.Num(), BestTimes[0] * 1e3, BestTimes[1] * 1e3);
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkCollision()
+{
+	noxelContainer->Empty();
+	for (int32 NumPanels : PanelCounts)
+	{
+		FillToPanelCount(NumPanels);
+		noxelContainer->UpdateMesh();
+		const FNoxelRendererShapeRef ProviderShape = noxelContainer->NoxelProvider->GetShape();
+		const TArray<FVector>& ProviderNodes = ProviderShape->Nodes;
+		const TArray<FNoxelRendererPanelData>& ProviderPanels = ProviderShape->Panels;
+
+		for (int32 bMergePanels = 0; bMergePanels < 2; ++bMergePanels)
+		{
+			FNoxelCollisionSimplificationSettings Simplification = noxelContainer->NoxelProvider->GetCollisionSimplification();
+			Simplification.bMergePanels = bMergePanels != 0;
+			TArray<FRuntimeMeshCollisionConvexMesh> ConvexElems;
+			const double BuildStart = FPlatformTime::Seconds();
+			UNoxelRMCProvider::BuildCollisionConvexes(ProviderNodes, ProviderPanels, Simplification, ConvexElems);
+			const double BuildTime = FPlatformTime::Seconds() - BuildStart;
+			int32 NumConvexVertices = 0;
+			for (const FRuntimeMeshCollisionConvexMesh& ConvexElem : ConvexElems)
+			{
+				NumConvexVertices += ConvexElem.VertexBuffer.Num();
+			}
+			UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkCollision] %d panels, %s : %d convex elements, %d convex vertices, built in %.2f ms"),
+				ProviderPanels.Num(), bMergePanels ? TEXT("merged") : TEXT("unmerged"), ConvexElems.Num(), NumConvexVertices, BuildTime * 1e3);
+		}
+	}
+}
+
+void ANoxelBenchmarkTester::BenchmarkNodesMemory()
+{
+	FRuntimeMeshRenderableMeshData NodeMesh;
+	if (!nodesContainer->BaseNodeMesh || !URuntimeMeshStaticMeshConverter::CopyStaticMeshSectionToRenderableMeshData(nodesContainer->BaseNodeMesh, 0, 0, NodeMesh))
+	{
+		UE_LOG(Noxel, Warning, TEXT("[ANoxelBenchmarkTester::BenchmarkNodesMemory] Couldn't read the node mesh"));
+		return;
+	}
+	//Default RMC vertex layout : position, packed normal and tangent, color, half precision UV
+	const int32 VertexSize = sizeof(FVector) + 2 * sizeof(FPackedNormal) + sizeof(FColor) + sizeof(FVector2DHalf);
+	//Transform and RGBA custom data of each instance, the node mesh itself is only stored once
+	const int32 InstanceSize = sizeof(FInstancedStaticMeshInstanceData) + 4 * sizeof(float);
+	const int32 NodeMeshSize = NodeMesh.Positions.Num() * VertexSize + NodeMesh.Triangles.Num() * sizeof(uint16);
+	for (int32 NumNodes : NodeCounts)
+	{
+		TArray<FNoxelRendererNodeData> Nodes;
+		Nodes.Reserve(NumNodes);
+		const int32 GridSize = FMath::CeilToInt(FMath::Pow(NumNodes, 1.f / 3.f));
+		for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+		{
+			const FVector Location(NodeIdx % GridSize, (NodeIdx / GridSize) % GridSize, NodeIdx / (GridSize * GridSize));
+			Nodes.Emplace(Location * 100.f, FColor::White);
+		}
+		FRuntimeMeshRenderableMeshData MeshData;
+		const double BuildStart = FPlatformTime::Seconds();
+		UNodesRMCProvider::BuildNodesMesh(NodeMesh, Nodes, MeshData);
+		const double BuildTime = FPlatformTime::Seconds() - BuildStart;
+		const int32 NumVertices = MeshData.Positions.Num();
+		const int32 IndexSize = NumVertices > (1 << 16) ? sizeof(uint32) : sizeof(uint16);
+		const int32 CopiedSize = NumVertices * VertexSize + MeshData.Triangles.Num() * IndexSize;
+		const int32 InstancedSize = NodeMeshSize + NumNodes * InstanceSize;
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkNodesMemory] %d nodes : copied meshes %d KB built in %.2f ms, instances %d KB"),
+			NumNodes, CopiedSize / 1024, BuildTime * 1e3, InstancedSize / 1024);
+	}
+}
+
+//Fills OutCubes with a solid block of NumCubes cubes, returns the size of the block's side
+static int32 MakeVoxelBlock(int32 NumCubes, TArray<FIntVector>& OutCubes)
+{
+	OutCubes.Reset(NumCubes);
+	const int32 GridSize = FMath::CeilToInt(FMath::Pow(NumCubes, 1.f / 3.f));
+	for (int32 CubeIdx = 0; CubeIdx < NumCubes; CubeIdx++)
+	{
+		OutCubes.Emplace(CubeIdx % GridSize, (CubeIdx / GridSize) % GridSize, CubeIdx / (GridSize * GridSize));
+	}
+	return GridSize;
+}
+
+void ANoxelBenchmarkTester::BenchmarkVoxels()
+{
+	const FIntVector Neighbours[6] = { FIntVector(1, 0, 0), FIntVector(-1, 0, 0), FIntVector(0, 1, 0), FIntVector(0, -1, 0), FIntVector(0, 0, 1), FIntVector(0, 0, -1) };
+	for (int32 NumCubes : VoxelCounts)
+	{
+		TArray<FIntVector> Cubes;
+		const int32 GridSize = MakeVoxelBlock(NumCubes, Cubes);
+
+		FVoxelChunkStore Voxels;
+		const double InsertStart = FPlatformTime::Seconds();
+		for (const FIntVector& Cube : Cubes)
+		{
+			Voxels.Add(Cube);
+		}
+		const double InsertTime = FPlatformTime::Seconds() - InsertStart;
+
+		int32 NumCovered = 0;
+		const double LookupStart = FPlatformTime::Seconds();
+		for (const FIntVector& Cube : Cubes)
+		{
+			for (const FIntVector& Neighbour : Neighbours)
+			{
+				NumCovered += Voxels.Contains(Cube + Neighbour);
+			}
+		}
+		const double LookupTime = FPlatformTime::Seconds() - LookupStart;
+
+		//Index 0 is one quad per face, index 1 is the greedy mesh
+		int32 NumTriangles[2];
+		double BuildTimes[2];
+		for (int32 bGreedy = 0; bGreedy < 2; bGreedy++)
+		{
+			FRuntimeMeshRenderableMeshData MeshData;
+			const double BuildStart = FPlatformTime::Seconds();
+			UVoxelRMCProvider::BuildVoxelMesh(Voxels, 10.f, MeshData, bGreedy != 0);
+			BuildTimes[bGreedy] = FPlatformTime::Seconds() - BuildStart;
+			NumTriangles[bGreedy] = MeshData.Triangles.Num() / 3;
+		}
+		TArray<FRuntimeMeshCollisionBox> Boxes;
+		UVoxelRMCProvider::BuildVoxelCollisionBoxes(Voxels, 10.f, Boxes);
+
+		//Rays from outside of the grid towards random cubes, as the voxel macros cast them
+		const int32 NumRays = 10000;
+		FRandomStream RayStream(NumCubes);
+		const FVector RayStart = FVector(-GridSize, -GridSize, 2 * GridSize);
+		int32 NumRayHits = 0;
+		const double RaycastStart = FPlatformTime::Seconds();
+		for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+		{
+			const FVector Target = FVector(Cubes[RayStream.RandHelper(NumCubes)]);
+			FVoxelRayHit Hit;
+			NumRayHits += Voxels.Raycast(RayStart, RayStart + (Target - RayStart) * 2, Hit);
+		}
+		const double RaycastTime = FPlatformTime::Seconds() - RaycastStart;
+
+		TArray<uint8> Encoded;
+		FMemoryWriter Writer(Encoded);
+		const double EncodeStart = FPlatformTime::Seconds();
+		Voxels.Save(Writer);
+		const double EncodeTime = FPlatformTime::Seconds() - EncodeStart;
+		FVoxelChunkStore DecodedVoxels;
+		FMemoryReader Reader(Encoded);
+		const double DecodeStart = FPlatformTime::Seconds();
+		bool bDecoded = DecodedVoxels.Load(Reader);
+		const double DecodeTime = FPlatformTime::Seconds() - DecodeStart;
+		//Same chunks holding the same cubes
+		bDecoded &= DecodedVoxels.Num() == Voxels.Num() && DecodedVoxels.GetChunks().Num() == Voxels.GetChunks().Num();
+		for (const TPair<FIntVector, FVoxelChunk>& Chunk : Voxels.GetChunks())
+		{
+			const FVoxelChunk* DecodedChunk = DecodedVoxels.FindChunk(Chunk.Key);
+			bDecoded &= DecodedChunk && FMemory::Memcmp(DecodedChunk->Bits, Chunk.Value.Bits, sizeof(Chunk.Value.Bits)) == 0;
+		}
+
+		//Malformed data has to be refused rather than read past its end
+		TArray<TArray<uint8>> MalformedData;
+		MalformedData.Emplace();
+		MalformedData.Emplace(Encoded.GetData(), 1);
+		MalformedData.Emplace(Encoded.GetData(), Encoded.Num() / 2);
+		MalformedData.Emplace(Encoded.GetData(), Encoded.Num() - 1);
+		{
+			//More chunks than the data could hold
+			FMemoryWriter MalformedWriter(MalformedData.AddDefaulted_GetRef());
+			uint32 NumChunks = 1000000;
+			MalformedWriter.SerializeIntPacked(NumChunks);
+		}
+		for (uint8 Encoding : { (uint8)FVoxelChunkReader::EChunkEncoding::Runs, (uint8)2 })
+		{
+			//A run past the end of the chunk, then an unknown encoding
+			FMemoryWriter MalformedWriter(MalformedData.AddDefaulted_GetRef());
+			uint32 Values[] = { 1, 0, 0, 0 };
+			for (uint32& Value : Values)
+			{
+				MalformedWriter.SerializeIntPacked(Value);
+			}
+			MalformedWriter << Encoding;
+			uint32 Runs[] = { 2, 0, 5000, 0, 0, 0, 0, 0 };
+			for (uint32& Run : Runs)
+			{
+				MalformedWriter.SerializeIntPacked(Run);
+			}
+		}
+		//A refused load has to leave the cubes as they were
+		int32 NumMalformedAccepted = 0;
+		for (const TArray<uint8>& Data : MalformedData)
+		{
+			FMemoryReader MalformedReader(Data);
+			NumMalformedAccepted += DecodedVoxels.Load(MalformedReader) || DecodedVoxels.Num() != Voxels.Num();
+		}
+
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : chunk store insert %.3f us/cube, neighbour lookup %.1f ns, %d KB in %d chunks"),
+			NumCubes, InsertTime * 1e6 / NumCubes, LookupTime * 1e9 / (6 * NumCubes), (int32)(Voxels.GetAllocatedSize() / 1024), Voxels.GetChunks().Num());
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : per face mesh %d triangles in %.2f ms, greedy mesh %d triangles in %.2f ms, %d collision boxes"),
+			NumCubes, NumTriangles[0], BuildTimes[0] * 1e3, NumTriangles[1], BuildTimes[1] * 1e3, Boxes.Num());
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : grid raycast %.1f ns/ray, %d/%d hits"),
+			NumCubes, RaycastTime * 1e9 / NumRays, NumRayHits, NumRays);
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : encoded in %d bytes (flat array %d bytes), encode %.2f ms, decode %.2f ms%s"),
+			NumCubes, Encoded.Num(), NumCubes * (int32)sizeof(FIntVector), EncodeTime * 1e3, DecodeTime * 1e3, bDecoded ? TEXT("") : TEXT(", decoded cubes differ"));
+		if (NumMalformedAccepted > 0)
+		{
+			UE_LOG(Noxel, Warning, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : %d/%d malformed encodings were accepted"),
+				NumCubes, NumMalformedAccepted, MalformedData.Num());
+		}
+
+		if (NumCubes <= MaxFlatArrayVoxelCount)
+		{
+			TArray<FIntVector> FlatCubes;
+			const double FlatInsertStart = FPlatformTime::Seconds();
+			for (const FIntVector& Cube : Cubes)
+			{
+				FlatCubes.AddUnique(Cube);
+			}
+			const double FlatInsertTime = FPlatformTime::Seconds() - FlatInsertStart;
+			int32 FlatNumCovered = 0;
+			const double FlatLookupStart = FPlatformTime::Seconds();
+			for (const FIntVector& Cube : FlatCubes)
+			{
+				for (const FIntVector& Neighbour : Neighbours)
+				{
+					FlatNumCovered += FlatCubes.Contains(Cube + Neighbour);
+				}
+			}
+			const double FlatLookupTime = FPlatformTime::Seconds() - FlatLookupStart;
+			UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxels] %d cubes : flat array insert %.3f us/cube, neighbour lookup %.1f ns%s"),
+				NumCubes, FlatInsertTime * 1e6 / NumCubes, FlatLookupTime * 1e9 / (6 * NumCubes), FlatNumCovered == NumCovered ? TEXT("") : TEXT(", results differ"));
+		}
+	}
+}
+
+void ANoxelBenchmarkTester::StartVoxelTraceBenchmark(int32 CountIdx)
+{
+	if (!VoxelCounts.IsValidIndex(CountIdx))
+	{
+		return;
+	}
+	TraceVoxelCountIdx = CountIdx;
+	VoxelTraceWaitTime = 0.f;
+
+	TArray<FIntVector> Cubes;
+	MakeVoxelBlock(VoxelCounts[CountIdx], Cubes);
+	FVoxelChunkStore Voxels;
+	for (const FIntVector& Cube : Cubes)
+	{
+		Voxels.Add(Cube);
+	}
+	TArray<uint8> Encoded;
+	FMemoryWriter Writer(Encoded);
+	Voxels.Save(Writer);
+
+	TraceVoxelComponent = NewObject<UVoxelComponent>(this);
+	TraceVoxelComponent->SetWorldLocation(GetActorLocation());
+	TraceVoxelComponent->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	TraceVoxelComponent->RegisterComponent();
+	TraceVoxelComponent->loadVoxels(Encoded);
+
+	const float PollPeriod = 0.1f;
+	GetWorldTimerManager().SetTimer(VoxelTraceTimer, this, &ANoxelBenchmarkTester::BenchmarkVoxelTrace, PollPeriod, true);
+}
+
+void ANoxelBenchmarkTester::BenchmarkVoxelTrace()
+{
+	const int32 NumCubes = VoxelCounts[TraceVoxelCountIdx];
+	FBodyInstance* Body = TraceVoxelComponent->GetBodyInstance();
+	if (!Body || !Body->IsValidBodyInstance())
+	{
+		VoxelTraceWaitTime += GetWorldTimerManager().GetTimerRate(VoxelTraceTimer);
+		if (VoxelTraceWaitTime < VoxelTraceTimeout)
+		{
+			return;
+		}
+		UE_LOG(Noxel, Warning, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxelTrace] %d cubes : collision not ready after %.1f s, skipped"), NumCubes, VoxelTraceWaitTime);
+	}
+	else
+	{
+		//Same rays as the grid raycast of BenchmarkVoxels, in world space
+		TArray<FIntVector> Cubes;
+		const int32 GridSize = MakeVoxelBlock(NumCubes, Cubes);
+		const FTransform& ComponentTransform = TraceVoxelComponent->GetComponentTransform();
+		const float CubeSize = TraceVoxelComponent->CubeRadius * 2;
+		const int32 NumRays = 10000;
+		FRandomStream RayStream(NumCubes);
+		const FVector RayStart = ComponentTransform.TransformPosition(FVector(-GridSize, -GridSize, 2 * GridSize) * CubeSize);
+		TArray<FVector> Starts, Ends;
+		Starts.Init(RayStart, NumRays);
+		Ends.Reserve(NumRays);
+		for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+		{
+			const FVector Target = ComponentTransform.TransformPosition(FVector(Cubes[RayStream.RandHelper(NumCubes)]) * CubeSize);
+			Ends.Add(RayStart + (Target - RayStart) * 2);
+		}
+
+		TArray<FVoxelRayHit> GridHits;
+		const double GridStart = FPlatformTime::Seconds();
+		TraceVoxelComponent->traceBatch(Starts, Ends, GridHits);
+		const double GridTime = FPlatformTime::Seconds() - GridStart;
+		int32 NumGridHits = 0;
+		for (const FVoxelRayHit& Hit : GridHits)
+		{
+			NumGridHits += Hit.bHit;
+		}
+
+		const FCollisionQueryParams Params(SCENE_QUERY_STAT(VoxelBenchmarkTrace), false);
+		int32 NumPhysicsHits = 0;
+		const double PhysicsStart = FPlatformTime::Seconds();
+		for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+		{
+			FHitResult Hit;
+			NumPhysicsHits += TraceVoxelComponent->LineTraceComponent(Hit, Starts[RayIdx], Ends[RayIdx], Params);
+		}
+		const double PhysicsTime = FPlatformTime::Seconds() - PhysicsStart;
+
+		UE_LOG(Noxel, Log, TEXT("[ANoxelBenchmarkTester::BenchmarkVoxelTrace] %d cubes : grid trace %.1f ns/ray, %d/%d hits, physics line trace %.1f ns/ray, %d/%d hits, collision ready after %.1f s"),
+			NumCubes, GridTime * 1e9 / NumRays, NumGridHits, NumRays, PhysicsTime * 1e9 / NumRays, NumPhysicsHits, NumRays, VoxelTraceWaitTime);
+	}
+
+	GetWorldTimerManager().ClearTimer(VoxelTraceTimer);
+	TraceVoxelComponent->DestroyComponent();
+	TraceVoxelComponent = nullptr;
+	StartVoxelTraceBenchmark(TraceVoxelCountIdx + 1);
+}
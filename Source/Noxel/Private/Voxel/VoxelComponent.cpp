@@ -2,6 +2,9 @@
 
 #include "Voxel/VoxelComponent.h"
 #include "Noxel.h"
+#include "Net/UnrealNetwork.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 
 UVoxelComponent::UVoxelComponent(const FObjectInitializer& ObjectInitializer)
@@ -15,6 +18,13 @@ UVoxelComponent::UVoxelComponent(const FObjectInitializer& ObjectInitializer)
 
 }
 
+void UVoxelComponent::PostInitProperties()
+{
+	Super::PostInitProperties();
+	//Set after the properties are copied from the archetype, which would point to the archetype
+	ReplicatedChunks.Owner = this;
+}
+
 void UVoxelComponent::OnRegister()
 {
 	Super::OnRegister();
@@ -26,6 +36,125 @@ void UVoxelComponent::BeginPlay()
 	Super::BeginPlay();
 }
 
+void UVoxelComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	DOREPLIFETIME(UVoxelComponent, ReplicatedChunks);
+}
+
+void UVoxelComponent::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+	//Edits between two net updates are sent as a single encoding of each chunk they touched
+	TArray<FVoxelChunkItem>& Items = ReplicatedChunks.Items;
+	for (const FIntVector& ChunkLocation : DirtyChunks)
+	{
+		const FVoxelChunk* Chunk = Voxels.FindChunk(ChunkLocation);
+		if (!Chunk)
+		{
+			int32 RemovedIdx;
+			if (ChunkItemIndices.RemoveAndCopyValue(ChunkLocation, RemovedIdx))
+			{
+				Items.RemoveAtSwap(RemovedIdx, 1, false);
+				if (Items.IsValidIndex(RemovedIdx))
+				{
+					ChunkItemIndices[Items[RemovedIdx].Location] = RemovedIdx;
+				}
+				ReplicatedChunks.MarkArrayDirty();
+			}
+			continue;
+		}
+		int32 ItemIdx;
+		if (const int32* FoundIdx = ChunkItemIndices.Find(ChunkLocation))
+		{
+			ItemIdx = *FoundIdx;
+		}
+		else
+		{
+			ItemIdx = Items.AddDefaulted();
+			Items[ItemIdx].Location = ChunkLocation;
+			ChunkItemIndices.Add(ChunkLocation, ItemIdx);
+		}
+		FVoxelChunkItem& Item = Items[ItemIdx];
+		Item.Data.Reset();
+		FMemoryWriter Writer(Item.Data);
+		FVoxelChunkStore::SaveChunk(Writer, *Chunk);
+		ReplicatedChunks.MarkItemDirty(Item);
+	}
+	DirtyChunks.Reset();
+}
+
+void FVoxelChunkItem::PostReplicatedAdd(const FVoxelChunkArray& InArraySerializer)
+{
+	if (InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->ReceiveChunk(Location, Data);
+	}
+}
+
+void FVoxelChunkItem::PostReplicatedChange(const FVoxelChunkArray& InArraySerializer)
+{
+	if (InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->ReceiveChunk(Location, Data);
+	}
+}
+
+void FVoxelChunkItem::PreReplicatedRemove(const FVoxelChunkArray& InArraySerializer)
+{
+	if (InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->ReceiveChunk(Location, TArray<uint8>());
+	}
+}
+
+void UVoxelComponent::ReceiveChunk(const FIntVector& ChunkLocation, const TArray<uint8>& Data)
+{
+	FVoxelChunk Chunk;
+	if (Data.Num() > 0)
+	{
+		FMemoryReader Reader(Data);
+		if (!FVoxelChunkReader::ReadChunkCubes(Reader, Chunk))
+		{
+			UE_LOG(NoxelDataNetwork, Warning, TEXT("[UVoxelComponent::ReceiveChunk] Received malformed chunk %s (%d bytes)"), *ChunkLocation.ToString(), Data.Num());
+			return;
+		}
+	}
+	Voxels.SetChunk(ChunkLocation, Chunk);
+	VoxelProvider->SetChunk(ChunkLocation, Chunk);
+}
+
+TArray<uint8> UVoxelComponent::saveVoxels() const
+{
+	TArray<uint8> data;
+	FMemoryWriter Writer(data);
+	Voxels.Save(Writer);
+	return data;
+}
+
+bool UVoxelComponent::loadVoxels(const TArray<uint8>& data)
+{
+	//Decoded aside so that malformed data changes nothing
+	FVoxelChunkStore Loaded;
+	FMemoryReader Reader(data);
+	if (!Loaded.Load(Reader))
+	{
+		return false;
+	}
+	//The chunks that were there are sent as removed if they aren't loaded back
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : Voxels.GetChunks())
+	{
+		DirtyChunks.Add(Chunk.Key);
+	}
+	Voxels = MoveTemp(Loaded);
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : Voxels.GetChunks())
+	{
+		DirtyChunks.Add(Chunk.Key);
+	}
+	VoxelProvider->SetVoxels(Voxels);
+	return true;
+}
+
 FIntVector UVoxelComponent::Round(FVector InVector) {
 	return FIntVector(FMath::RoundToInt(InVector.X),
 		FMath::RoundToInt(InVector.Y),
@@ -34,32 +163,50 @@ FIntVector UVoxelComponent::Round(FVector InVector) {
 
 void UVoxelComponent::addCube(FIntVector location)
 {
-	Cubes.AddUnique(location);
-	VoxelProvider->SetCubes(Cubes);
+	if (Voxels.Add(location))
+	{
+		VoxelProvider->AddCube(location);
+		DirtyChunks.Add(FVoxelChunkStore::CubeToChunk(location));
+	}
 }
 
 void UVoxelComponent::removeCube(FIntVector location)
 {
-	Cubes.Remove(location);
-	VoxelProvider->SetCubes(Cubes);
+	if (Voxels.Remove(location))
+	{
+		VoxelProvider->RemoveCube(location);
+		DirtyChunks.Add(FVoxelChunkStore::CubeToChunk(location));
+	}
+}
+
+FVector UVoxelComponent::WorldToGrid(const FTransform& InverseTransform, const FVector& Location) const
+{
+	return InverseTransform.TransformPosition(Location) / (CubeRadius * 2);
 }
 
 bool UVoxelComponent::trace(FVector start, FVector end, FIntVector& cube_hit, FIntVector& hit_normal)
 {
-	FHitResult hit;
-	FCollisionQueryParams Params = FCollisionQueryParams();
-	//Params.bTraceComplex = true;
-	if (LineTraceComponent(hit, start, end, Params)) {
-		FTransform world = GetComponentTransform();
-		FVector locrel = world.InverseTransformPosition(hit.Location), dirrel = world.InverseTransformVector(hit.Normal);
-		hit_normal = Round(dirrel); //Equals rounding the dir
-		cube_hit = Round((locrel / CubeRadius*0.5f) //Position of the hit inside the voxel
-			- dirrel/2.f); //Go into the cube
+	const FTransform InverseTransform = GetComponentTransform().Inverse();
+	FVoxelRayHit hit;
+	if (Voxels.Raycast(WorldToGrid(InverseTransform, start), WorldToGrid(InverseTransform, end), hit)) {
+		cube_hit = hit.Cube;
+		hit_normal = hit.Normal;
 		return true;
 	}
 	return false;
 }
 
+void UVoxelComponent::traceBatch(TArrayView<const FVector> starts, TArrayView<const FVector> ends, TArray<FVoxelRayHit>& hits)
+{
+	check(starts.Num() == ends.Num());
+	const FTransform InverseTransform = GetComponentTransform().Inverse();
+	hits.SetNum(starts.Num());
+	for (int32 RayIdx = 0; RayIdx < starts.Num(); RayIdx++)
+	{
+		Voxels.Raycast(WorldToGrid(InverseTransform, starts[RayIdx]), WorldToGrid(InverseTransform, ends[RayIdx]), hits[RayIdx]);
+	}
+}
+
 FVector UVoxelComponent::voxelToWorld(FIntVector cube)
 {
 	return GetComponentTransform().TransformPosition((FVector)cube*CubeRadius*2);
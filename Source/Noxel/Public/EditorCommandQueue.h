@@ -301,9 +301,9 @@ struct NOXEL_API FEditorQueue
 
 	void AddNodeReferenceOrder(TArray<FVector> Locations, UNodesContainer* Container);
 
-	TMap<FNodeID, int32> CreateNodeReferenceOrdersFromNodeList(TArray<FNodeID> Nodes);
+	TMap<FNodeID, int32> CreateNodeReferenceOrdersFromNodeList(TArrayView<const FNodeID> Nodes);
 
-	static TArray<int32> NodeListToNodeReferences(TArray<FNodeID> Nodes, const TMap<FNodeID, int32> &NodeMap);
+	static TArray<int32> NodeListToNodeReferences(TArrayView<const FNodeID> Nodes, const TMap<FNodeID, int32> &NodeMap);
 
 	void AddNodeAddOrder(const TArray<int32> &NodeToAdd);
 	void AddNodeRemoveOrder(const TArray<int32> &NodeToRemove);
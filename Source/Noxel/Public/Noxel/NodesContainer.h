@@ -10,6 +10,7 @@
 #include "NodesContainer.generated.h"
 
 class UNodesRMCProvider;
+class UInstancedStaticMeshComponent;
 
 UCLASS(ClassGroup = "Noxel", Blueprintable, meta=(BlueprintSpawnableComponent) )
 class NOXEL_API UNodesContainer : public UNoxelDataComponent
@@ -24,14 +25,15 @@ protected:
 
 	void OnRegister() override;
 
+	void OnComponentDestroyed(bool bDestroyingHierarchy) override;
+
 	// Called when the game starts
 	virtual void BeginPlay() override;
 	virtual void PostInitProperties() override;
-
-public:
-
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void PostLoad() override;
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
 
 private:
 
@@ -45,6 +47,22 @@ private:
 	UPROPERTY(EditAnywhere)
 	float NodeSize;
 
+	//Locations closer than this designate the same node, so that nodes moved by transforms still match
+	UPROPERTY(EditAnywhere)
+	float LocationTolerance;
+
+	//Index in Nodes of the nodes in each cell of a grid of LocationTolerance sized cells
+	TMultiMap<FIntVector, int32> NodeGrid;
+
+	//Handle of each node, parallel to Nodes
+	//Rebuilt by RebuildNodeIndex wherever Nodes is replaced without going through AddNode
+	TArray<FNodeHandle> NodeHandles;
+	//Index in Nodes of the node in each slot, INDEX_NONE if the slot is free
+	TArray<int32> SlotNodeIndices;
+	//Current generation of each slot
+	TArray<int32> SlotGenerations;
+	TArray<int32> FreeSlots;
+
 	//Should this Nodes Container be editable by the player ?
 	UPROPERTY(EditAnywhere)
 	bool bPlayerEditable;
@@ -56,6 +74,10 @@ private:
 private:
 	UNodesRMCProvider* NodesProvider;
 
+	//Renders the nodes when bInstancedRendering, the provider then only builds the collision
+	UPROPERTY(Transient)
+	UInstancedStaticMeshComponent* NodesInstances;
+
 	//Noxel Container this Nodes container is attached to
 	UPROPERTY(Replicated)
 		UNoxelContainer* AttachedNoxel;
@@ -65,6 +87,10 @@ public:
 	UStaticMesh* BaseNodeMesh; //Mesh used to render the nodes, has to have bAllowCPUAcess
 	UPROPERTY(EditAnywhere)
 	UMaterialInterface* NodeMaterial; //Material used to render the nodes
+	//Render the nodes as instances of BaseNodeMesh instead of copying it for each node
+	//NodeMaterial then has to read the node color from PerInstanceCustomData 0 to 3 instead of the vertex color
+	UPROPERTY(EditAnywhere)
+	bool bInstancedRendering;
 
 	UFUNCTION(BlueprintCallable, BlueprintPure)
 	float GetNodeSize() const
@@ -81,33 +107,81 @@ public:
 
 	bool AddNode(FVector Location);
 
-	static bool AddNode(FNodeID Node);
+	bool AddNode(FVector Location, FNodeHandle& OutHandle);
+
+	//Sets the handle of Node once added
+	static bool AddNode(FNodeID& Node);
 
 	//Set the default configuration of nodes, use in constructor only
 	bool SetNodesDefault(TArray<FVector> InNodes, bool bInPlayerEditable);
 
-	bool AttachNode(const FVector Location, const FPanelID Panel);
+	//Nodes are found by the handle of their id, ids made from a location have to be resolved first
+	bool AttachNode(const FNodeID& Node, const FPanelID Panel);
 
-	bool DetachNode(const FVector Location, const FPanelID Panel);
+	bool DetachNode(const FNodeID& Node, const FPanelID Panel);
 
 	//Does not allow removing a node that is connected to panels
 	bool RemoveNode(FVector Location);
 
 	static bool RemoveNode(FNodeID Node);
 
-	bool SetNodeColor(FVector Location, FColor color);
+	bool SetNodeColor(const FNodeID& Node, FColor color);
+
+	//Returns true if all the nodes were found
+	bool SetNodesColor(const TArray<FNodeID>& InNodes, FColor color);
 
 	bool FindNode(FVector Location, FNodeID& FoundNode);
 
-	TArray<int32> GetAttachedPanels(FVector Location) const; //Returns the panel index of the attached panels, belonging to the attached Noxel container
+	//Gives its handle to an id made from a location, returns false if there is no node there or if the node of its handle was removed
+	static bool ResolveNode(FNodeID& Node);
+
+	//Returns the panel index of the attached panels, belonging to the attached Noxel container
+	//The view points into the node's data and is only valid until the nodes of this container are modified
+	TArrayView<const int32> GetAttachedPanels(const FNodeID& Node) const;
 
 	TArray<FNodeID> GenerateNodesKeyArray() const;
 
+	//CPU memory used by the nodes and the tables indexing them, in bytes
+	SIZE_T GetNodesAllocatedSize() const;
+
 	static bool GetNodeHit(FHitResult Hit, FNodeID& HitNode);
 
 private:
 	void MarkMeshDirty();
 
+	FIntVector LocationToCell(const FVector& Location) const;
+
+	//Index in Nodes of the node closest to Location within LocationTolerance, INDEX_NONE if there is none
+	int32 FindNodeIndex(const FVector& Location) const;
+
+	//Index in Nodes of the node of an id of this container, INDEX_NONE if it has no handle or if its node was removed
+	int32 FindNodeIndex(const FNodeID& Node) const;
+
+	void RebuildNodeGrid();
+
+	//Gives a new slot to every node and rebuilds the grid, to call whenever Nodes is replaced as a whole
+	//Every handle given before is invalidated
+	void RebuildNodeIndex();
+
+	//Rebuilds the index only if Nodes was filled without it, by serialization or from the archetype
+	void RebuildNodeIndexIfNeeded();
+
+	//Index in Nodes of the node of a handle, INDEX_NONE if it was removed
+	int32 ResolveNodeHandle(FNodeHandle Handle) const;
+
+	FNodeHandle AllocateSlot(int32 NodeIdx);
+
+	//Removes the node by swapping the last node in its place
+	void RemoveNodeAt(int32 NodeIdx);
+
+	//Transform of the instance rendering the node at Location, scaled so that the mesh has the size of the node
+	FTransform GetNodeInstanceTransform(FVector Location) const;
+
+	void UpdateNodesInstances();
+
+	//Sends the colors of some nodes to the renderer without rebuilding the whole mesh
+	void PatchNodesColor(const TArray<int32>& NodeIndices);
+
 	void AttachToNoxelContainer(UNoxelContainer* NoxelContainer);
 
 public:
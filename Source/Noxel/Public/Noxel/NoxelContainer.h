@@ -8,6 +8,7 @@
 #include "NoxelContainer.generated.h"
 
 class UNoxelRMCProvider;
+struct FNoxelRendererPanelData;
 
 UCLASS(ClassGroup = "Noxel", Blueprintable, meta=(BlueprintSpawnableComponent) )
 class NOXEL_API UNoxelContainer : public UNoxelDataComponent
@@ -37,6 +38,12 @@ private:
 	//UPROPERTY(BlueprintReadWrite)
 	TArray<FPanelData> Panels;
 
+	//Links a PanelIndex to the index of that panel in the Panels array
+	TMap<int32, int32> PanelIndexToArrayIndex;
+
+	//Links each side of the finished (non differed) panels to the PanelIndex of the panels using it
+	TMap<FNodeEdge, TArray<int32>> EdgeToPanels;
+
 	UPROPERTY(ReplicatedUsing=OnRep_ConnectedNodesContainers)
 	TArray<UNodesContainer*> ConnectedNodesContainers; //Used for networking, automatically populated by the nodes container, though unlikely to run out
 
@@ -46,17 +53,35 @@ private:
 	TArray<int32> ReservedIndices;
 	int32 MaxIndex; //Maximum given index, to use when UnusedIndices is empty
 
-	TArray<int32> ModifiedPanels;
-
-	TArray<int32> DifferedPanels;
+	//PanelIndex of the panels whose renderer data has to be sent to the provider again, removed panels included
+	TSet<int32> ModifiedPanels;
+	//Should the provider be rebuilt from scratch on the next update ?
+	bool bProviderDataDirty;
+
+	//Node stored at each index of the provider's nodes array
+	TArray<FNodeID> ExportedNodes;
+	//Number of exported panels using the node at each index of the provider's nodes array
+	TArray<int32> ExportedNodesRefCount;
+	//Index in the provider's nodes array of each exported node
+	TMap<FNodeID, int32> ExportedNodeIndices;
+	//Nodes of each exported panel as they were sent to the provider, by PanelIndex
+	TMap<int32, FPanelNodesArray> ExportedPanelNodes;
+	//Transform of each nodes container relative to this container when its nodes were sent to the provider
+	//Weak as the containers aren't referenced by this map, entries are pruned when the container is disconnected or destroyed
+	TMap<TWeakObjectPtr<UNodesContainer>, FTransform> ExportedNodesContainersTransforms;
+
+	TSet<int32> DifferedPanels;
 
 	//OutPanels is an array of PanelIndex, outOccurences is the number of nodes this panel shares with this collection,
 	//OutNodesAttachedBy are the nodes shared, IgnoreFilter is an array of PanelIndex to ignore
-	static bool FindPanelsByNodes(TArray<FNodeID>& Nodes, TArray<int32>& OutPanels, TArray<int32>& OutOccurences,
-	                              TArray<TArray<FNodeID>>& OutNodesAttachedBy, TArray<int32> IgnoreFilter);
+	static bool FindPanelsByNodes(TArrayView<const FNodeID> Nodes, TArray<int32>& OutPanels, TArray<int32>& OutOccurences,
+	                              TArray<TArray<FNodeID>>& OutNodesAttachedBy, const TArray<int32>& IgnoreFilter);
 
 	//Gives the index in Panels of the panel with the wanted PanelIndex
-	bool GetIndexOfPanelByPanelIndex(int32 PanelIndex, int32& OutIndexInArray);
+	bool GetIndexOfPanelByPanelIndex(int32 PanelIndex, int32& OutIndexInArray) const;
+
+	//Removes the panel at the given index in Panels, the last panel is swapped into its place
+	void RemovePanelAt(int32 IndexInArray);
 
 private:
 	
@@ -65,11 +90,35 @@ private:
 	//Checks panel validity and outputs intermediate adjacency computations
 	bool IsPanelValid(FPanelData &data, TArray<int32> &AdjacentPanels,TArray<int32> &Occurrences, TArray<TArray<FNodeID>> &NodesAttachedBy) const;
 
+	//Location of each node of the panel relative to this container, reads the nodes containers so game thread only
+	void GetPanelNodeLocations(const FPanelData& data, TArray<FVector>& OutNodeLocations) const;
+
 	//Fits a plane, reorder nodes and computes area
 	void ComputePanelGeometricData(FPanelData &data);
 
-	//Fills the adjacent panels information from given adjacency computations 
-	void GetAdjacentPanelsFromNodes(FPanelData &data, const TArray<int32> &AdjacentPanels, const TArray<int32> &Occurrences, const TArray<TArray<FNodeID>> &NodesAttachedBy);
+	//Same from the node locations given by GetPanelNodeLocations, only touches the panel so it can run on any thread
+	static void ComputePanelGeometricData(FPanelData& data, const TArray<FVector>& NodeLocationsRelativeToNoxel);
+
+	//Adds the sides of the panel to the edge table, nodes have to be ordered
+	void RegisterPanelEdges(const FPanelData &data);
+
+	//Removes the sides of the panel from the edge table
+	void UnregisterPanelEdges(const FPanelData &data);
+
+	//Puts the panel back in differed mode, removing its sides from the edge table as its nodes are about to change
+	void MarkPanelDiffered(const FPanelData &data);
+
+	//Removes the connections between this panel and the panels it was connected to
+	void DisconnectAdjacentPanels(FPanelData &data);
+
+	//Connects this panel to the panels sharing one of its sides, using the edge table
+	void ConnectAdjacentPanels(FPanelData &data);
+
+	//Same as ConnectAdjacentPanels, but keeps the connections the panel already has
+	void LinkAdjacentPanels(FPanelData &data);
+
+	//Fills the side adjacency of the renderer data with, for each side of the panel, the PanelIndex of the other panels sharing it
+	void GetSideAdjacency(const FPanelData &data, FNoxelRendererPanelData &OutRendererData) const;
 
 	//Pops an unused index or gives a new one
 	int32 GetNewPanelIndex();
@@ -99,6 +148,11 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool AddPanel(FPanelData data);
 
+	//Only use for saving or loading
+	//Adds all the panels at once : they are validated in order, then their geometry is computed in parallel and their adjacency wired in a single pass
+	//The PanelIndex of each panel is written back, INDEX_NONE if it couldn't be added. Returns the number of panels added
+	int32 AddPanels(TArrayView<FPanelData> InPanels);
+
 	//Only use for saving or loading
 	UFUNCTION(BlueprintCallable)
 	bool RemovePanel(int32 index);
@@ -110,8 +164,11 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool GetPanelByNodes(TArray<FNodeID> Nodes, int32& PanelIndex);
 
-	UFUNCTION(BlueprintPure)
-	TArray<FPanelData> GetPanels() const;
+	//Valid until the panels of this container are modified
+	const TArray<FPanelData>& GetPanels() const;
+
+	UFUNCTION(BlueprintPure, meta = (DisplayName = "Get Panels"))
+	TArray<FPanelData> K2_GetPanels() const;
 
 	UFUNCTION(BlueprintCallable)
 	static bool GetPanelHit(FHitResult hit, FPanelID& PanelHit);
@@ -121,9 +178,18 @@ public:
 
 	void Empty();
 
+	//CPU memory used by the panels and the tables indexing them, in bytes
+	SIZE_T GetPanelsAllocatedSize() const;
+
 	
 
 private:
+	void MarkPanelModified(int32 PanelIndex);
+
+	//Records the transforms of the connected nodes containers, returns true if one moved since it was last recorded
+	bool UpdateNodesContainersTransforms();
+
+	//Sends the renderer data of the modified panels to the provider
 	void UpdateProviderData();
 
 	//virtual UBodySetup* GetBodySetup() override;
@@ -137,4 +203,5 @@ public:
 	
 	friend class UNodesContainer;
 	friend class ANoxelPlayerController;
+	friend class ANoxelBenchmarkTester;
 };
@@ -34,9 +34,18 @@ public:
 
 	virtual ECraftSpawnContext GetSpawnContext();
 
+	/*
+	Should the component only build its collision ? True on dedicated servers, where nothing is ever rendered
+	The spawn context alone isn't enough, as clients render battle crafts too
+	*/
+	virtual bool IsCollisionOnly() const;
+
 	virtual bool IsConnected();
 
 	virtual bool CheckDataValidity();
 
 	virtual void UpdateMesh();
+
+	//Updates the mesh at the end of the frame, once even if queued several times
+	void QueueMeshUpdate();
 };
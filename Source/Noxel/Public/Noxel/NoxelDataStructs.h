@@ -16,6 +16,44 @@ enum class ECraftSpawnContext : uint8 {
 	Battle	UMETA(DisplayName = "Loaded in battle")
 };
 
+//Slot of a node in its nodes container, the generation changes every time the slot is freed so that old handles don't resolve to a new node
+//Handles are only valid for the container that issued them, saves and network messages keep using locations and indices
+USTRUCT(BlueprintType)
+struct NOXEL_API FNodeHandle
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Slot;
+	UPROPERTY(BlueprintReadOnly)
+	int32 Generation;
+
+	FNodeHandle()
+		: Slot(INDEX_NONE),
+		Generation(0)
+	{}
+
+	FNodeHandle(const int32 InSlot, const int32 InGeneration)
+		: Slot(InSlot),
+		Generation(InGeneration)
+	{}
+
+	bool IsSet() const
+	{
+		return Slot != INDEX_NONE;
+	}
+
+	FORCEINLINE bool operator== (const FNodeHandle& Other) const
+	{
+		return Other.Slot == Slot && Other.Generation == Generation;
+	}
+
+	friend uint32 GetTypeHash(const FNodeHandle& Other)
+	{
+		return HashCombine(GetTypeHash(Other.Slot), GetTypeHash(Other.Generation));
+	}
+};
+
 USTRUCT(BlueprintType)
 struct NOXEL_API FNodeID
 {
@@ -26,25 +64,40 @@ struct NOXEL_API FNodeID
 	UNodesContainer* Object;
 	UPROPERTY(BlueprintReadWrite)
 	FVector Location;
+	//Identity of the node in its container, set on every id given out by the container
+	//Ids made from a location only get one through UNodesContainer::FindNode or ResolveNode, or once their node is added
+	UPROPERTY(BlueprintReadOnly)
+	FNodeHandle Handle;
 
 	FNodeID()
 		: Object(),
-		Location(FVector::ZeroVector)
+		Location(FVector::ZeroVector),
+		Handle()
 	{}
 
+	//Id of a node that doesn't exist yet, or that still has to be resolved
 	FNodeID(const UNodesContainer* InObject, const FVector InLocation)
 		: Object(InObject),
-		Location(InLocation)
+		Location(InLocation),
+		Handle()
 	{}
 
+	FNodeID(const UNodesContainer* InObject, const FVector InLocation, const FNodeHandle InHandle)
+		: Object(InObject),
+		Location(InLocation),
+		Handle(InHandle)
+	{}
+
+	//Ids are compared by container and handle, the location is only an attribute
+	//Ids without a handle of the same container all compare equal, they have to be resolved before being used as keys
 	FORCEINLINE bool operator== (const FNodeID& Other) const
 	{
-		return (Other.Object == Object && Other.Location == Location);
+		return Other.Object == Object && Other.Handle == Handle;
 	}
 
 	friend uint32 GetTypeHash(const FNodeID& Other)
 	{
-		return GetTypeHash(Other.Location);
+		return HashCombine(PointerHash(Other.Object), GetTypeHash(Other.Handle));
 	}
 
 	static FNodeID FromWorld(UNodesContainer* InObject, FVector WorldLocation);
@@ -66,6 +119,28 @@ struct NOXEL_API FNodeID
 
 };
 
+//Undirected edge between two nodes, (A,B) and (B,A) are the same edge
+struct FNodeEdge
+{
+	FNodeID A;
+	FNodeID B;
+
+	FNodeEdge(const FNodeID& InA, const FNodeID& InB)
+		: A(InA),
+		B(InB)
+	{}
+
+	FORCEINLINE bool operator== (const FNodeEdge& Other) const
+	{
+		return (Other.A == A && Other.B == B) || (Other.A == B && Other.B == A);
+	}
+
+	friend uint32 GetTypeHash(const FNodeEdge& Other)
+	{
+		return GetTypeHash(Other.A) ^ GetTypeHash(Other.B); //Symmetric so that both directions hash the same
+	}
+};
+
 USTRUCT(BlueprintType)
 struct NOXEL_API FPanelID
 {
@@ -102,6 +177,13 @@ struct NOXEL_API FPanelID
 	}
 };
 
+//Nodes and panels are only connected to a handful of each other : most panels have 3 to 6 nodes and most nodes are used by 1 to 4 panels
+//These arrays keep that many elements inline so that a node or a panel doesn't own any heap allocation in the common case
+//UHT only reflects arrays using the default allocator, so fields of these types can't be UPROPERTYs, use the accessors on UNoxelLibrary from blueprints
+typedef TArray<int32, TInlineAllocator<4>> FNodeConnectedPanelsArray;
+typedef TArray<FNodeID, TInlineAllocator<6>> FPanelNodesArray;
+typedef TArray<int32, TInlineAllocator<6>> FPanelConnectedPanelsArray;
+
 //Data structure used by the nodes container to store nodes
 
 USTRUCT(BlueprintType)
@@ -115,8 +197,8 @@ struct NOXEL_API FNodeData
 	UPROPERTY(BlueprintReadWrite)
 	FColor Color;
 
-	UPROPERTY(BlueprintReadWrite)
-	TArray<int32> ConnectedPanels;
+	//PanelIndex of the panels using this node
+	FNodeConnectedPanelsArray ConnectedPanels;
 
 	FNodeData()
 		:Location(),
@@ -147,9 +229,9 @@ struct NOXEL_API FNodeData
 		return Other.Location == Location;
 	}
 
-	FORCEINLINE FNodeID ToNodeID(const UNodesContainer* InObject) const
+	FORCEINLINE FNodeID ToNodeID(const UNodesContainer* InObject, const FNodeHandle InHandle) const
 	{
-		return FNodeID(InObject, Location);
+		return FNodeID(InObject, Location, InHandle);
 	}
 };
 
@@ -160,10 +242,8 @@ struct NOXEL_API FPanelData
 
 	UPROPERTY(BlueprintReadWrite)
 	int32 PanelIndex;
-	UPROPERTY(BlueprintReadWrite)
-	TArray<FNodeID> Nodes;
-	UPROPERTY(BlueprintReadWrite)
-	TArray<int32> ConnectedPanels; //Array of the other panels' PanelIndex, not index in the array
+	FPanelNodesArray Nodes;
+	FPanelConnectedPanelsArray ConnectedPanels; //Array of the other panels' PanelIndex, not index in the array
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float ThicknessNormal;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
@@ -272,7 +352,7 @@ struct NOXEL_API FNodeSavedRedirector {
 
 	friend uint32 GetTypeHash(const FNodeSavedRedirector& Other)
 	{
-		return GetTypeHash(FString::FromInt(Other.parentIndex) + " " + FString::FromInt(Other.nodesContainerIndex) + " " + FString::FromInt(Other.nodeIndex));
+		return HashCombine(HashCombine(GetTypeHash(Other.parentIndex), GetTypeHash(Other.nodesContainerIndex)), GetTypeHash(Other.nodeIndex));
 	}
 };
 
@@ -6,6 +6,7 @@
 
 #include "CoreMinimal.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
+#include "Noxel/NoxelDataStructs.h"
 #include "NoxelLibrary.generated.h"
 
 
@@ -82,6 +83,25 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Noxel|Vectors")
 		static bool getClosestPointOnTwoLines(FVector Line1Point, FVector Line1Direction, FVector Line2Point, FVector Line2Direction, FVector& ClosestPointOnLine1, FVector& ClosestPointOnLine2);
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//Data -------------------------------------------------------------------------------------------------------------------------
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	//The nodes and connections of FPanelData and FNodeData use inline allocators and can't be reflected, these expose them to blueprints
+
+	UFUNCTION(BlueprintPure, Category = "Noxel|Data")
+		static TArray<FNodeID> GetPanelNodes(const FPanelData& Panel);
+	UFUNCTION(BlueprintCallable, Category = "Noxel|Data")
+		static void SetPanelNodes(UPARAM(ref) FPanelData& Panel, const TArray<FNodeID>& InNodes);
+	UFUNCTION(BlueprintPure, Category = "Noxel|Data")
+		static TArray<int32> GetPanelConnectedPanels(const FPanelData& Panel);
+	UFUNCTION(BlueprintCallable, Category = "Noxel|Data")
+		static void SetPanelConnectedPanels(UPARAM(ref) FPanelData& Panel, const TArray<int32>& InConnectedPanels);
+	UFUNCTION(BlueprintPure, Category = "Noxel|Data")
+		static TArray<int32> GetNodeConnectedPanels(const FNodeData& Node);
+	UFUNCTION(BlueprintCallable, Category = "Noxel|Data")
+		static void SetNodeConnectedPanels(UPARAM(ref) FNodeData& Node, const TArray<int32>& InConnectedPanels);
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Raycast ----------------------------------------------------------------------------------------------------------------------
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,51 @@
+//Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "NoxelMeshUpdateSubsystem.generated.h"
+
+class UNoxelDataComponent;
+
+/**
+ * Collects the noxel data components whose mesh has to be updated and updates each of them once per frame
+ */
+UCLASS(Config = Game)
+class NOXEL_API UNoxelMeshUpdateSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	//Time that can be spent updating meshes each frame, in milliseconds, 0 to update all the queued components in the same frame
+	//At least one component is updated each frame
+	UPROPERTY(Config)
+	float FrameBudgetMs;
+
+private:
+	//Components waiting for an update, in the order they were first queued
+	TArray<TWeakObjectPtr<UNoxelDataComponent>> DirtyComponents;
+	//Same components, to only queue them once
+	TSet<TWeakObjectPtr<UNoxelDataComponent>> DirtyComponentsSet;
+
+public:
+	UNoxelMeshUpdateSubsystem();
+
+	virtual void Deinitialize() override;
+
+	//Queues the mesh update of a component, does nothing if it is already queued
+	void MarkDirty(UNoxelDataComponent* Component);
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableInEditor() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+
+private:
+	//Updates the components queued before the call until they are all updated or BudgetSeconds elapsed, no budget if BudgetSeconds <= 0
+	void Flush(double BudgetSeconds);
+};
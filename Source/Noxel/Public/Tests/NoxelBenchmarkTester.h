@@ -0,0 +1,118 @@
+// Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NObjects/NoxelPart.h"
+#include "NoxelBenchmarkTester.generated.h"
+
+class UVoxelComponent;
+
+/**
+ * Fills its noxel container with a flat triangulated grid and logs timings of the container operations
+ */
+UCLASS(BlueprintType)
+class NOXEL_API ANoxelBenchmarkTester : public ANoxelPart
+{
+	GENERATED_BODY()
+	
+public:
+	ANoxelBenchmarkTester();
+
+	//Sizes of the noxel container to benchmark at, in panels
+	UPROPERTY(EditAnywhere)
+	TArray<int32> PanelCounts;
+
+	//Number of panels added then removed at each size to measure the per operation cost
+	UPROPERTY(EditAnywhere)
+	int32 NumSamples;
+
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkPanelInsertRemove;
+
+	//Logs the CPU memory used per panel and per node at each size, to be tracked across builds
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkPanelsMemory;
+
+	//Compares the full intersection cache bake on one thread and on the task graph workers
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkIntersectionBake;
+
+	//Number of times each bake or mesh build is timed, the best time is kept
+	UPROPERTY(EditAnywhere)
+	int32 NumBakeRuns;
+
+	//Compares the size of the LOD0 render mesh with and without shared vertices, and the build time with callbacks and templated writers
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkMeshBuild;
+
+	//Compares the number of convex elements of the simple collision with and without merging panels
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkCollision;
+
+	//Numbers of nodes to compare the CPU memory of the copied node meshes and of the node instances at
+	UPROPERTY(EditAnywhere)
+	TArray<int32> NodeCounts;
+
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkNodesMemory;
+
+	//Numbers of cubes to time the voxel store and the voxel mesh build at, cubes fill a solid block
+	UPROPERTY(EditAnywhere)
+	TArray<int32> VoxelCounts;
+
+	//The flat array the voxels used to be stored in is only timed up to this many cubes, as its cost is quadratic
+	UPROPERTY(EditAnywhere)
+	int32 MaxFlatArrayVoxelCount;
+
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkVoxels;
+
+	//Compares the voxel component's grid trace to a physics line trace against its collision boxes, at each of VoxelCounts once the collision is cooked
+	UPROPERTY(EditAnywhere)
+	bool bBenchmarkVoxelTrace;
+
+	//Time to wait for the voxel collision to be cooked before giving up, in seconds
+	UPROPERTY(EditAnywhere)
+	float VoxelTraceTimeout;
+
+protected:
+	virtual void BeginPlay() override;
+
+private:
+	//Nodes of each panel of the grid, 3 per panel
+	TArray<FNodeID> GridPanelNodes;
+
+	//Adds the nodes of a flat grid holding at least NumPanels triangles
+	void MakeGrid(int32 NumPanels);
+
+	//Adds the panels of the grid to the noxel container until it holds NumPanels panels
+	void FillToPanelCount(int32 NumPanels);
+
+	void BenchmarkPanelInsertRemove();
+
+	void BenchmarkPanelsMemory();
+
+	void BenchmarkIntersectionBake();
+
+	void BenchmarkMeshBuild();
+
+	void BenchmarkCollision();
+
+	void BenchmarkNodesMemory();
+
+	void BenchmarkVoxels();
+
+	//Voxel component holding the cubes of VoxelCounts[TraceVoxelCountIdx] while its collision cooks
+	UPROPERTY()
+	UVoxelComponent* TraceVoxelComponent;
+	int32 TraceVoxelCountIdx;
+	float VoxelTraceWaitTime;
+	FTimerHandle VoxelTraceTimer;
+
+	//Spawns the voxel component for VoxelCounts[CountIdx] and waits for its collision
+	void StartVoxelTraceBenchmark(int32 CountIdx);
+
+	//Polled until the collision of TraceVoxelComponent is ready, then times the traces and goes on with the next count
+	void BenchmarkVoxelTrace();
+};
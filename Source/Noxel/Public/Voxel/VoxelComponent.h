@@ -4,11 +4,58 @@
 
 #include "CoreMinimal.h"
 #include "RuntimeMeshComponent.h"
+#include "Net/Serialization/FastArraySerializer.h"
 
 #include "VoxelRMCProvider.h"
 
 #include "VoxelComponent.generated.h"
 
+class UVoxelComponent;
+
+//Cubes of one chunk, replicated on their own so that an edit only sends and remeshes the chunks it touched
+USTRUCT()
+struct FVoxelChunkItem : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FIntVector Location = FIntVector::ZeroValue;
+
+	//Cubes in the compact format of FVoxelChunkStore::SaveChunk
+	UPROPERTY()
+	TArray<uint8> Data;
+
+	void PostReplicatedAdd(const struct FVoxelChunkArray& InArraySerializer);
+	void PostReplicatedChange(const struct FVoxelChunkArray& InArraySerializer);
+	void PreReplicatedRemove(const struct FVoxelChunkArray& InArraySerializer);
+};
+
+USTRUCT()
+struct FVoxelChunkArray : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FVoxelChunkItem> Items;
+
+	UPROPERTY(NotReplicated)
+	UVoxelComponent* Owner = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FVoxelChunkItem, FVoxelChunkArray>(Items, DeltaParms, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FVoxelChunkArray> : public TStructOpsTypeTraitsBase2<FVoxelChunkArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
 /**
  * 
  */
@@ -24,19 +71,40 @@ public:
 
 protected:
 
+	void PostInitProperties() override;
+
 	void OnRegister() override;
 
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
 private:
 
 	UVoxelRMCProvider* VoxelProvider;
 
-	TArray<FIntVector> Cubes;
+	//Cubes of the component, the provider keeps its own copy for the render and collision threads
+	FVoxelChunkStore Voxels;
+
+	//One item per chunk, only the chunks edited since the last net update are encoded again
+	UPROPERTY(Replicated)
+	FVoxelChunkArray ReplicatedChunks;
+	//Index in ReplicatedChunks.Items of each chunk
+	TMap<FIntVector, int32> ChunkItemIndices;
+	//Chunks edited since the last net update
+	TSet<FIntVector> DirtyChunks;
+
+	friend struct FVoxelChunkItem;
+	//Applies a chunk received from the server, an empty Data removes it
+	void ReceiveChunk(const FIntVector& ChunkLocation, const TArray<uint8>& Data);
 
 	FIntVector Round(FVector InVector);
 
+	//World location to cube coordinates, not rounded
+	FVector WorldToGrid(const FTransform& InverseTransform, const FVector& Location) const;
+
 public:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Default)
@@ -51,9 +119,21 @@ public:
 	UFUNCTION(BlueprintCallable)
 		void removeCube(FIntVector location);
 
+	//Walks the cubes crossed by the segment, doesn't need the collision to be cooked
 	UFUNCTION(BlueprintCallable)
 		bool trace(FVector start, FVector end, FIntVector& cube_hit, FIntVector& hit_normal);
 
+	//Same as trace for many segments at once, in world space
+	void traceBatch(TArrayView<const FVector> starts, TArrayView<const FVector> ends, TArray<FVoxelRayHit>& hits);
+
+	//Compact copy of the cubes, for saving
+	UFUNCTION(BlueprintCallable)
+		TArray<uint8> saveVoxels() const;
+
+	//Replaces the cubes by the ones saved by saveVoxels, returns false and changes nothing if the data is malformed
+	UFUNCTION(BlueprintCallable)
+		bool loadVoxels(const TArray<uint8>& data);
+
 	UFUNCTION(BlueprintCallable)
 		FVector voxelToWorld(FIntVector cube);
 
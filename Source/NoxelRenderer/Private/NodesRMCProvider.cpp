@@ -48,8 +48,40 @@ void UNodesRMCProvider::SetNodes(const TArray<FNoxelRendererNodeData>& InNodes)
 	TArray<FVector> nodespos(InNodes);
 	BakedNodeBounds = FBoxSphereBounds(nodespos.GetData(), nodespos.Num());
 	Nodes = InNodes;
+	NodesVersion++;
+	bIsCachedMeshDirty = true;
+	CachedMesh = FRuntimeMeshRenderableMeshData();
 	MarkCollisionDirty();
-	MarkSectionDirty(0, 0);
+	if (!bCollisionOnly)
+	{
+		MarkSectionDirty(0, 0);
+	}
+}
+
+void UNodesRMCProvider::SetNodesColor(const TArray<TPair<int32, FColor>>& InColors)
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	const int32 NumVerts = StaticMeshRenderable.Positions.Num();
+	for (const TPair<int32, FColor>& NodeColor : InColors)
+	{
+		if (!Nodes.IsValidIndex(NodeColor.Key))
+		{
+			continue;
+		}
+		Nodes[NodeColor.Key].Color = NodeColor.Value;
+		if (!bIsCachedMeshDirty)
+		{
+			for (int32 VertIdx = NodeColor.Key * NumVerts; VertIdx < (NodeColor.Key + 1) * NumVerts; VertIdx++)
+			{
+				CachedMesh.Colors.SetColor(VertIdx, NodeColor.Value);
+			}
+		}
+	}
+	NodesVersion++;
+	if (!bCollisionOnly)
+	{
+		MarkSectionDirty(0, 0);
+	}
 }
 
 UMaterialInterface* UNodesRMCProvider::GetNodesMaterial() const
@@ -65,12 +97,86 @@ void UNodesRMCProvider::SetNodesMaterial(UMaterialInterface* InNodesMaterial)
 	SetupMaterialSlot(0, FName("Nodes"), NodesMaterial);
 }
 
-bool UNodesRMCProvider::GetHitNodeIndex(int32 faceIndex, int32 & HitNode) const
+bool UNodesRMCProvider::IsCollisionOnly() const
 {
 	FScopeLock Lock(&PropertySyncRoot);
-	HitNode = faceIndex / (StaticMeshCollidable.Triangles.Num());
-	//UE_LOG(NoxelRendererLog, Log, TEXT("[UNodesRMCProvider::GetHitNodeIndex(%d, %d)] NumTriangles = %d"), faceIndex, HitNode, StaticMeshCollidable.Triangles.Num());
-	return Nodes.IsValidIndex(HitNode);
+	return bCollisionOnly;
+}
+
+void UNodesRMCProvider::SetCollisionOnly(bool bInCollisionOnly)
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	bCollisionOnly = bInCollisionOnly;
+	if (bCollisionOnly)
+	{
+		StaticMeshRenderable = FRuntimeMeshRenderableMeshData();
+	}
+}
+
+bool UNodesRMCProvider::GetNodeOnRay(const FVector& RayStart, const FVector& RayEnd, int32& HitNode) const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	const FVector RayDirection = (RayEnd - RayStart).GetSafeNormal();
+	const float RayLength = (RayEnd - RayStart).Size();
+	const float RadiusSquared = FMath::Square(BakedMeshBounds.SphereRadius);
+	float BestDistance = RayLength;
+	HitNode = INDEX_NONE;
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); NodeIdx++)
+	{
+		const FVector ToStart = RayStart - (Nodes[NodeIdx].RelativeLocation + BakedMeshBounds.Origin);
+		const float B = ToStart | RayDirection;
+		const float C = ToStart.SizeSquared() - RadiusSquared;
+		if (C > 0.f && B > 0.f)
+		{
+			continue; //Starts outside of the sphere and goes away from it
+		}
+		const float Discriminant = B * B - C;
+		if (Discriminant < 0.f)
+		{
+			continue;
+		}
+		const float Distance = FMath::Max(-B - FMath::Sqrt(Discriminant), 0.f);
+		if (Distance <= BestDistance)
+		{
+			BestDistance = Distance;
+			HitNode = NodeIdx;
+		}
+	}
+	return HitNode != INDEX_NONE;
+}
+
+void UNodesRMCProvider::BuildNodesMesh(const FRuntimeMeshRenderableMeshData& NodeMesh, const TArray<FNoxelRendererNodeData>& InNodes, FRuntimeMeshRenderableMeshData& MeshData)
+{
+	const int32 NumNodes = InNodes.Num();
+	const int32 NumVerts = NodeMesh.Positions.Num();
+	const int32 NumTris = NodeMesh.Triangles.Num();
+	MeshData.Positions.Reserve(NumNodes * NumVerts);
+	MeshData.Tangents.Reserve(NumNodes * NumVerts);
+	MeshData.Colors.Reserve(NumNodes * NumVerts);
+	MeshData.TexCoords.Reserve(NumNodes * NumVerts);
+	MeshData.Triangles.Reserve(NumNodes * NumTris);
+
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		const FNoxelRendererNodeData& Node = InNodes[NodeIdx];
+		FVector Nodepos = Node.RelativeLocation;
+
+		//Copy position and offset by node pos
+		for (int32 VertIdx = 0; VertIdx < NumVerts; VertIdx++)
+		{
+			MeshData.Positions.Add(NodeMesh.Positions.GetPosition(VertIdx) + Nodepos);
+			MeshData.Colors.Add(Node.Color);
+		}
+		//Append other buffers
+		MeshData.Tangents.Append(NodeMesh.Tangents);
+		MeshData.TexCoords.Append(NodeMesh.TexCoords);
+
+		//Copy triangles
+		for (int32 TrisIdx = 0; TrisIdx < NumTris; TrisIdx++)
+		{
+			MeshData.Triangles.Add(NodeMesh.Triangles.GetVertexIndex(TrisIdx) + NodeIdx * NumVerts);
+		}
+	}
 }
 
 
@@ -82,6 +188,13 @@ void UNodesRMCProvider::Initialize()
 
 	ConfigureLODs({ LODProperties });
 
+	if (IsCollisionOnly())
+	{
+		//No section, the mesh only exists for its collision
+		MarkCollisionDirty();
+		return;
+	}
+
 	SetupMaterialSlot(0, FName("Nodes"), GetNodesMaterial());
 
 	FRuntimeMeshSectionProperties Properties;
@@ -108,41 +221,39 @@ FBoxSphereBounds UNodesRMCProvider::GetBounds()
 bool UNodesRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData)
 {	// We should only ever be queried for section 0 and lod 0
 	check(SectionId == 0 && LODIndex == 0);
-
-	FRuntimeMeshRenderableMeshData TempStaticMeshRenderable; TArray<FNoxelRendererNodeData> TempNodes;
-	GetShapeMeshParams(TempStaticMeshRenderable, TempNodes);
-	const int32 NumNodes = TempNodes.Num();
-	if (NumNodes == 0)
+	if (IsCollisionOnly())
 	{
 		return false;
 	}
-	const int32 NumVerts = TempStaticMeshRenderable.Positions.Num();
-	const int32 NumTris = TempStaticMeshRenderable.Triangles.Num();
-	MeshData.Positions.Reserve(NumNodes * NumVerts);
-	MeshData.Tangents.Reserve(NumNodes * NumVerts);
-	MeshData.Colors.Reserve(NumNodes * NumVerts);
-	MeshData.TexCoords.Reserve(NumNodes * NumVerts);
-	MeshData.Triangles.Reserve(NumNodes * NumTris);
 
-	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
 	{
-		FNoxelRendererNodeData Node = TempNodes[NodeIdx];
-		FVector Nodepos = Node.RelativeLocation;
-
-		//Copy position and offset by node pos
-		for (int32 VertIdx = 0; VertIdx < NumVerts; VertIdx++)
+		FScopeLock Lock(&PropertySyncRoot);
+		if (Nodes.Num() == 0)
 		{
-			MeshData.Positions.Add(TempStaticMeshRenderable.Positions.GetPosition(VertIdx) + Nodepos);
-			MeshData.Colors.Add(Node.Color);
+			return false;
 		}
-		//Append other buffers
-		MeshData.Tangents.Append(TempStaticMeshRenderable.Tangents);
-		MeshData.TexCoords.Append(TempStaticMeshRenderable.TexCoords);
+		if (!bIsCachedMeshDirty)
+		{
+			MeshData = CachedMesh;
+			return true;
+		}
+	}
 
-		//Copy triangles
-		for (int32 TrisIdx = 0; TrisIdx < NumTris; TrisIdx++)
+	FRuntimeMeshRenderableMeshData TempStaticMeshRenderable; TArray<FNoxelRendererNodeData> TempNodes; uint32 TempNodesVersion;
+	GetShapeMeshParams(TempStaticMeshRenderable, TempNodes, TempNodesVersion);
+	const int32 NumNodes = TempNodes.Num();
+	if (NumNodes == 0)
+	{
+		return false;
+	}
+	BuildNodesMesh(TempStaticMeshRenderable, TempNodes, MeshData);
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		if (NodesVersion == TempNodesVersion)
 		{
-			MeshData.Triangles.Add(TempStaticMeshRenderable.Triangles.GetVertexIndex(TrisIdx) + NodeIdx * NumVerts);
+			//Nothing changed while building, later patches can be applied to this mesh
+			CachedMesh = MeshData;
+			bIsCachedMeshDirty = false;
 		}
 	}
 	/*UE_LOG(NoxelRendererLog, Log, TEXT("[UNodesRMCProvider::GetSectionMeshForLOD] Printing"))
@@ -175,19 +286,20 @@ bool UNodesRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FR
 
 FRuntimeMeshCollisionSettings UNodesRMCProvider::GetCollisionSettings()
 {
+	FScopeLock Lock(&PropertySyncRoot);
 	FRuntimeMeshCollisionSettings Settings;
 	Settings.bUseAsyncCooking = true;
 	Settings.bUseComplexAsSimple = false;
 	Settings.CookingMode = ERuntimeMeshCollisionCookingMode::CollisionPerformance;
 
-	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); NodeIdx++)
+	//One sphere per node, the same one GetNodeOnRay tests against, instead of a copy of the node mesh per node
+	Settings.Spheres.Reserve(Nodes.Num());
+	for (const FNoxelRendererNodeData& Node : Nodes)
 	{
-		for (int32 SphereIdx = 0; SphereIdx < StaticMeshSettings.Spheres.Num(); SphereIdx++)
-		{
-			FRuntimeMeshCollisionSphere sphere = StaticMeshSettings.Spheres[SphereIdx];
-			sphere.Center += Nodes[NodeIdx].RelativeLocation;
-			Settings.Spheres.Add(sphere);
-		}
+		FRuntimeMeshCollisionSphere Sphere;
+		Sphere.Center = Node.RelativeLocation + BakedMeshBounds.Origin;
+		Sphere.Radius = BakedMeshBounds.SphereRadius;
+		Settings.Spheres.Add(Sphere);
 	}
 
 	return Settings;
@@ -195,46 +307,13 @@ FRuntimeMeshCollisionSettings UNodesRMCProvider::GetCollisionSettings()
 
 bool UNodesRMCProvider::HasCollisionMesh()
 {
-	return Nodes.Num() != 0;
+	//The collision is only made of spheres
+	return false;
 }
 
 bool UNodesRMCProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData)
 {
-	FRuntimeMeshCollisionData TempStaticMeshCollidable; TArray<FNoxelRendererNodeData> TempNodes;
-	GetShapeCollisionParams(TempStaticMeshCollidable, TempNodes);
-	int32 NumNodes = TempNodes.Num();
-	if (NumNodes == 0)
-	{
-		return false;
-	}
-	int32 NumVerts = TempStaticMeshCollidable.Vertices.Num();
-	int32 NumTris = TempStaticMeshCollidable.Triangles.Num();
-
-	CollisionData.Vertices.SetNum(NumNodes * NumVerts);
-	CollisionData.Triangles.SetNum(NumNodes * NumTris);
-
-	for (int32 NodeIdx = 0; NodeIdx < TempNodes.Num(); NodeIdx++)
-	{
-		FNoxelRendererNodeData Node = TempNodes[NodeIdx];
-		FVector Nodepos = Node.RelativeLocation;
-
-		//Copy position and offset by node pos
-		for (int32 VertIdx = 0; VertIdx < NumVerts; VertIdx++)
-		{
-			CollisionData.Vertices.SetPosition(VertIdx + NumVerts * NodeIdx, TempStaticMeshCollidable.Vertices.GetPosition(VertIdx) + Nodepos);
-		}
-
-		//Copy triangles
-		for (int32 TrisIdx = 0; TrisIdx < NumTris; TrisIdx++)
-		{
-			int32 A, B, C;
-			TempStaticMeshCollidable.Triangles.GetTriangleIndices(TrisIdx, A, B, C);
-			CollisionData.Triangles.SetTriangleIndices(TrisIdx + NodeIdx * NumTris, A + NodeIdx * NumTris * 3, B + NodeIdx * NumTris * 3, C + NodeIdx * NumTris * 3);
-		}
-	}
-	//UE_LOG(NoxelRendererLog, Log, TEXT("[UNodesRMCProvider::GetCollisionMesh] Recreated, %d nodes"), NumNodes);
-
-	return true;
+	return false;
 }
 
 bool UNodesRMCProvider::IsThreadSafe()
@@ -248,10 +327,12 @@ void UNodesRMCProvider::PrepareStaticMesh()
 	{
 		return;
 	}
-	URuntimeMeshStaticMeshConverter::CopyStaticMeshSectionToRenderableMeshData(StaticMesh, 0, 0, StaticMeshRenderable);
-	URuntimeMeshStaticMeshConverter::CopyStaticMeshLODToCollisionData(StaticMesh, 0, StaticMeshCollidable);
-	URuntimeMeshStaticMeshConverter::CopyStaticMeshCollisionToCollisionSettings(StaticMesh, StaticMeshSettings);
+	if (!bCollisionOnly)
+	{
+		URuntimeMeshStaticMeshConverter::CopyStaticMeshSectionToRenderableMeshData(StaticMesh, 0, 0, StaticMeshRenderable);
+	}
 	FBoxSphereBounds MeshBounds = StaticMesh->GetBounds();
+	//Renderable data is empty in collision only mode
 	for (int32 VertxIdx = 0; VertxIdx < StaticMeshRenderable.Positions.Num(); VertxIdx++)
 	{
 		FVector Position = StaticMeshRenderable.Positions.GetPosition(VertxIdx);
@@ -272,40 +353,23 @@ void UNodesRMCProvider::PrepareStaticMesh()
 		StaticMeshRenderable.Tangents.SetNormal(VertxIdx, Normal);
 		StaticMeshRenderable.Tangents.SetTangent(VertxIdx, Tangent);
 	}
-	for (int32 VertxIdx = 0; VertxIdx < StaticMeshCollidable.Vertices.Num(); VertxIdx++)
-	{
-		FVector Position = StaticMeshCollidable.Vertices.GetPosition(VertxIdx);
-		Position -= MeshBounds.Origin;
-		Position *= WantedMeshBounds.BoxExtent / MeshBounds.BoxExtent;
-		Position += WantedMeshBounds.Origin;
-		StaticMeshCollidable.Vertices.SetPosition(VertxIdx, Position);
-	}
-	for (int32 SphColIdx = 0; SphColIdx < StaticMeshSettings.Spheres.Num(); SphColIdx++)
-	{
-		FVector Position = StaticMeshSettings.Spheres[SphColIdx].Center;
-		Position -= MeshBounds.Origin;
-		Position *= WantedMeshBounds.BoxExtent / MeshBounds.BoxExtent;
-		Position += WantedMeshBounds.Origin;
-		StaticMeshSettings.Spheres[SphColIdx].Center = Position;
-		StaticMeshSettings.Spheres[SphColIdx].Radius *= WantedMeshBounds.BoxExtent.Size() / MeshBounds.BoxExtent.Size();
-	}
 	BakedMeshBounds = WantedMeshBounds;
+	NodesVersion++;
+	bIsCachedMeshDirty = true;
 	MarkCollisionDirty();
-	MarkAllLODsDirty();
+	if (!bCollisionOnly)
+	{
+		MarkAllLODsDirty();
+	}
 }
 
-void UNodesRMCProvider::GetShapeMeshParams(FRuntimeMeshRenderableMeshData & OutStaticMeshRenderable, TArray<FNoxelRendererNodeData>& OutNodes)
+void UNodesRMCProvider::GetShapeMeshParams(FRuntimeMeshRenderableMeshData & OutStaticMeshRenderable, TArray<FNoxelRendererNodeData>& OutNodes, uint32& OutNodesVersion)
 {
 	FScopeLock Lock(&PropertySyncRoot);
 	OutStaticMeshRenderable = StaticMeshRenderable;
 	OutNodes = Nodes;
+	OutNodesVersion = NodesVersion;
 }
 
-void UNodesRMCProvider::GetShapeCollisionParams(FRuntimeMeshCollisionData & OutStaticMeshCollidable, TArray<FNoxelRendererNodeData>& OutNodes)
-{
-	FScopeLock Lock(&PropertySyncRoot);
-	OutStaticMeshCollidable = StaticMeshCollidable;
-	OutNodes = Nodes;
-}
 
 
@@ -4,6 +4,17 @@
 #include "Kismet/KismetMathLibrary.h"
 #include "Modifiers/RuntimeMeshModifierNormals.h"
 #include "NoxelRenderer.h"
+#include "Async/ParallelFor.h"
+#include "Algo/BinarySearch.h"
+
+//Edge length of the spatial chunks panels are bucketed in, each chunk being rendered by its own section
+#define NOXEL_CHUNK_SIZE 1000.f
+
+//Number of panels baked by one task of the ParallelFor, they share the same scratch buffers
+#define INTERSECTION_BAKE_BATCH_SIZE 64
+
+DECLARE_CYCLE_STAT(TEXT("Make intersection cache"), STAT_NoxelMakeCache, STATGROUP_NoxelRenderer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Recomputed panels"), STAT_NoxelRecomputedPanels, STATGROUP_NoxelRenderer);
 
 struct AngleIndexPair
 {
@@ -30,38 +41,230 @@ struct AngleIndexPair
 
 };
 
+//Attributes that have to match for two vertices to be merged
+struct FNoxelVertexKey
+{
+	FVector Position;
+	FVector Normal;
+	FVector2D TexCoord;
+
+	FNoxelVertexKey(const FVector& InPosition, const FVector& InNormal, const FVector2D& InTexCoord)
+		: Position(InPosition),
+		Normal(InNormal),
+		TexCoord(InTexCoord)
+	{}
+
+	FORCEINLINE friend bool operator==(const FNoxelVertexKey& lhs, const FNoxelVertexKey& rhs)
+	{
+		return lhs.Position == rhs.Position && lhs.Normal == rhs.Normal && lhs.TexCoord == rhs.TexCoord;
+	}
+
+	FORCEINLINE friend uint32 GetTypeHash(const FNoxelVertexKey& Key)
+	{
+		return HashCombine(HashCombine(GetTypeHash(Key.Position), GetTypeHash(Key.Normal)), GetTypeHash(Key.TexCoord));
+	}
+};
+
+//Buffers reused between the panels baked by the same task, to avoid allocating per side
+struct FNoxelIntersectionScratch
+{
+	TArray<FNoxelRendererAdjacencyData> PanelAdjacency;
+	TArray<AngleIndexPair> PanelCandidates;
+};
+
 TArray<FVector> UNoxelRMCProvider::GetNodes() const
 {
-	FScopeLock Lock(&PropertySyncRoot);
-	return Nodes;
+	return GetShape()->Nodes;
 }
 
 void UNoxelRMCProvider::SetNodes(UPARAM(ref) const TArray<FVector>& InNodes)
 {
-	MarkCacheDirty();
-	FScopeLock Lock(&PropertySyncRoot);
-	Nodes = InNodes;
-	MarkAllLODsDirty();
+	bool bRendered;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		EditShape().Nodes = InNodes;
+		bRendered = !bCollisionOnly;
+	}
+	if (bRendered)
+	{
+		MarkCacheDirty();
+		MarkAllLODsDirty();
+	}
 	MarkCollisionDirty();
 }
 
 TArray<FNoxelRendererPanelData> UNoxelRMCProvider::GetPanels() const
 {
-	FScopeLock Lock(&PropertySyncRoot);
-	return Panels;
+	return GetShape()->Panels;
 }
 
 void UNoxelRMCProvider::SetPanels(UPARAM(ref) const TArray<FNoxelRendererPanelData>& InPanels)
 {
-	MarkCacheDirty();
+	bool bRendered;
 	{
 		FScopeLock Lock(&PropertySyncRoot);
-		Panels = InPanels;
+		EditShape().Panels = InPanels;
+		bRendered = !bCollisionOnly;
 	}
+	if (!bRendered)
+	{
+		MarkCollisionDirty();
+		return;
+	}
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		//Sections are kept so that the ones left without panels get cleared
+		for (TArray<int32>& Section : SectionPanels)
+		{
+			Section.Reset();
+		}
+		const int32 NumPanels = Shape->Panels.Num();
+		PanelSections.Init(INDEX_NONE, NumPanels);
+		TSet<int32> DirtySections;
+		for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
+		{
+			AssignPanelSection(PanelIdx, DirtySections);
+		}
+	}
+	MarkCacheDirty();
+	CreateMissingSections();
 	MarkAllLODsDirty();
 	MarkCollisionDirty();
 }
 
+void UNoxelRMCProvider::ApplyDelta(const FNoxelRendererDelta& Delta)
+{
+	TSet<int32> DirtyPanels; //Panels whose intersections changed : the modified ones and their neighbours, before and after the change
+	TSet<int32> DirtySections; //Sections holding a dirty panel, or that lost one
+	bool bRendered;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		bRendered = !bCollisionOnly;
+		FNoxelRendererShape& NewShape = EditShape();
+		TArray<FVector>& Nodes = NewShape.Nodes;
+		TArray<FNoxelRendererPanelData>& Panels = NewShape.Panels;
+		Nodes.SetNum(Delta.NumNodes);
+		for (const TPair<int32, FVector>& Node : Delta.Nodes)
+		{
+			Nodes[Node.Key] = Node.Value;
+		}
+		if (bRendered)
+		{
+			for (const TPair<int32, FNoxelRendererPanelData>& Panel : Delta.Panels)
+			{
+				if (Panels.IsValidIndex(Panel.Key))
+				{
+					DirtyPanels.Append(Panels[Panel.Key].AdjacentPanels);
+				}
+			}
+			for (int32 PanelIdx = Delta.NumPanels; PanelIdx < Panels.Num(); PanelIdx++)
+			{
+				RemovePanelSection(PanelIdx, DirtySections);
+			}
+			PanelSections.SetNum(FMath::Min(PanelSections.Num(), Delta.NumPanels));
+			while (PanelSections.Num() < Delta.NumPanels)
+			{
+				PanelSections.Add(INDEX_NONE);
+			}
+		}
+		Panels.SetNum(Delta.NumPanels);
+		for (const TPair<int32, FNoxelRendererPanelData>& Panel : Delta.Panels)
+		{
+			Panels[Panel.Key] = Panel.Value;
+			if (bRendered)
+			{
+				DirtyPanels.Add(Panel.Key);
+				DirtyPanels.Append(Panel.Value.AdjacentPanels);
+				RemovePanelSection(Panel.Key, DirtySections);
+				AssignPanelSection(Panel.Key, DirtySections);
+			}
+		}
+		for (int32 PanelIdx : DirtyPanels)
+		{
+			if (PanelSections.IsValidIndex(PanelIdx) && PanelSections[PanelIdx] != INDEX_NONE)
+			{
+				DirtySections.Add(PanelSections[PanelIdx]);
+			}
+		}
+	}
+	if (bRendered)
+	{
+		MarkCachedPanelsDirty(DirtyPanels);
+		if (CreateMissingSections())
+		{
+			for (int32 SectionId : DirtySections)
+			{
+				for (int32 LODIndex = 0; LODIndex < 3; LODIndex++)
+				{
+					MarkSectionDirty(LODIndex, SectionId);
+				}
+			}
+		}
+	}
+	MarkCollisionDirty();
+}
+
+TArray<int32> UNoxelRMCProvider::GetPanelNodes(const FNoxelRendererPanelData& Panel)
+{
+	return TArray<int32>(Panel.Nodes);
+}
+
+void UNoxelRMCProvider::SetPanelNodes(FNoxelRendererPanelData& Panel, const TArray<int32>& InNodes)
+{
+	Panel.Nodes = InNodes;
+}
+
+TArray<int32> UNoxelRMCProvider::GetPanelAdjacentPanels(const FNoxelRendererPanelData& Panel)
+{
+	return TArray<int32>(Panel.AdjacentPanels);
+}
+
+void UNoxelRMCProvider::SetPanelAdjacentPanels(FNoxelRendererPanelData& Panel, const TArray<int32>& InAdjacentPanels)
+{
+	Panel.AdjacentPanels = InAdjacentPanels;
+}
+
+void UNoxelRMCProvider::GetPanelSideAdjacency(const FNoxelRendererPanelData& Panel, TArray<int32>& OutSideAdjacentPanels, TArray<int32>& OutSideAdjacencyOffsets)
+{
+	OutSideAdjacentPanels = TArray<int32>(Panel.SideAdjacentPanels);
+	OutSideAdjacencyOffsets = TArray<int32>(Panel.SideAdjacencyOffsets);
+}
+
+void UNoxelRMCProvider::SetPanelSideAdjacency(FNoxelRendererPanelData& Panel, const TArray<int32>& InSideAdjacentPanels, const TArray<int32>& InSideAdjacencyOffsets)
+{
+	Panel.SideAdjacentPanels = InSideAdjacentPanels;
+	Panel.SideAdjacencyOffsets = InSideAdjacencyOffsets;
+}
+
+SIZE_T UNoxelRMCProvider::GetPanelsAllocatedSize() const
+{
+	const FNoxelRendererShapeRef CurrentShape = GetShape();
+	SIZE_T Size = CurrentShape->Panels.GetAllocatedSize();
+	for (const FNoxelRendererPanelData& Panel : CurrentShape->Panels)
+	{
+		//Zero unless the panel outgrew its inline storage
+		Size += Panel.Nodes.GetAllocatedSize() + Panel.AdjacentPanels.GetAllocatedSize()
+			+ Panel.SideAdjacentPanels.GetAllocatedSize() + Panel.SideAdjacencyOffsets.GetAllocatedSize();
+	}
+	return Size;
+}
+
+FNoxelRendererShapeRef UNoxelRMCProvider::GetShape() const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	return Shape;
+}
+
+FNoxelRendererShape& UNoxelRMCProvider::EditShape()
+{
+	//Readers only get a reference under PropertySyncRoot, so nobody can start reading a shape we hold the only reference to
+	if (!Shape.IsUnique())
+	{
+		Shape = MakeShared<FNoxelRendererShape, ESPMode::ThreadSafe>(*Shape);
+	}
+	return *Shape;
+}
+
 UMaterialInterface* UNoxelRMCProvider::GetNoxelMaterial() const
 {
 	FScopeLock Lock(&PropertySyncRoot);
@@ -75,11 +278,30 @@ void UNoxelRMCProvider::SetNoxelMaterial(UMaterialInterface* InNoxelMaterial)
 	SetupMaterialSlot(0, FName("Noxel"), NoxelMaterial);
 }
 
+bool UNoxelRMCProvider::IsCollisionOnly() const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	return bCollisionOnly;
+}
+
+void UNoxelRMCProvider::SetCollisionOnly(bool bInCollisionOnly)
+{
+	FScopeLock Lock(&PropertySyncRoot);
+	if (NumCreatedSections != INDEX_NONE)
+	{
+		UE_LOG(NoxelRendererLog, Warning, TEXT("[UNoxelRMCProvider::SetCollisionOnly] Provider is already initialized, ignoring"));
+		return;
+	}
+	bCollisionOnly = bInCollisionOnly;
+}
+
 bool UNoxelRMCProvider::GetPanelIndexHit(int32 HitTriangleIndex, int32& OutPanelIndex) const
 {
-	if (CollisionMap.IsValidIndex(HitTriangleIndex))
+	//Last range starting at or before the hit triangle
+	const int32 RangeIdx = Algo::UpperBoundBy(CollisionMap, HitTriangleIndex, [](const TPair<int32, int32>& Range) { return Range.Key; }) - 1;
+	if (HitTriangleIndex >= 0 && CollisionMap.IsValidIndex(RangeIdx) && CollisionMap[RangeIdx].Value != INDEX_NONE)
 	{
-		OutPanelIndex = CollisionMap[HitTriangleIndex];
+		OutPanelIndex = CollisionMap[RangeIdx].Value;
 		return true;
 	}
 	else
@@ -305,11 +527,80 @@ float UNoxelRMCProvider::ComputeTriangleFanArea(FVector Center, TArray<FVector>
 	return area;
 }
 
-void UNoxelRMCProvider::GetShapeParams(TArray<FVector>& OutNodes, TArray<FNoxelRendererPanelData>& OutPanels)
+FNoxelRendererShapeRef UNoxelRMCProvider::GetSectionShapeParams(int32 SectionId, TArray<FNoxelRendererPanelData>& OutPanels, TArray<int32>& OutPanelIndices)
 {
 	FScopeLock Lock(&PropertySyncRoot);
-	OutNodes = Nodes;
-	OutPanels = Panels;
+	OutPanelIndices = SectionPanels.IsValidIndex(SectionId) ? SectionPanels[SectionId] : TArray<int32>();
+	OutPanels.Reset(OutPanelIndices.Num());
+	for (int32 PanelIdx : OutPanelIndices)
+	{
+		OutPanels.Add(Shape->Panels[PanelIdx]);
+	}
+	return Shape;
+}
+
+FIntVector UNoxelRMCProvider::LocationToChunk(const FVector& Location)
+{
+	return FIntVector((Location / NOXEL_CHUNK_SIZE).GridSnap(1.f));
+}
+
+void UNoxelRMCProvider::AssignPanelSection(int32 PanelIdx, TSet<int32>& OutDirtySections)
+{
+	const FIntVector Chunk = LocationToChunk(Shape->Panels[PanelIdx].Center);
+	int32 SectionId;
+	if (const int32* ExistingSectionId = ChunkSections.Find(Chunk))
+	{
+		SectionId = *ExistingSectionId;
+	}
+	else
+	{
+		SectionId = SectionPanels.AddDefaulted();
+		ChunkSections.Add(Chunk, SectionId);
+	}
+	SectionPanels[SectionId].Add(PanelIdx);
+	PanelSections[PanelIdx] = SectionId;
+	OutDirtySections.Add(SectionId);
+}
+
+void UNoxelRMCProvider::RemovePanelSection(int32 PanelIdx, TSet<int32>& OutDirtySections)
+{
+	if (!PanelSections.IsValidIndex(PanelIdx) || PanelSections[PanelIdx] == INDEX_NONE)
+	{
+		return;
+	}
+	const int32 SectionId = PanelSections[PanelIdx];
+	SectionPanels[SectionId].RemoveSingleSwap(PanelIdx);
+	PanelSections[PanelIdx] = INDEX_NONE;
+	OutDirtySections.Add(SectionId);
+}
+
+bool UNoxelRMCProvider::CreateMissingSections()
+{
+	int32 FirstSectionId, NumSections;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		if (NumCreatedSections == INDEX_NONE)
+		{
+			//Not initialized yet, Initialize will create them
+			return false;
+		}
+		FirstSectionId = NumCreatedSections;
+		NumSections = SectionPanels.Num();
+		NumCreatedSections = NumSections;
+	}
+	for (int32 SectionId = FirstSectionId; SectionId < NumSections; SectionId++)
+	{
+		for (int32 LODIndex = 0; LODIndex < 3; LODIndex++)
+		{
+			FRuntimeMeshSectionProperties Properties;
+			Properties.bCastsShadow = true;
+			Properties.bIsVisible = true;
+			Properties.MaterialSlot = 0;
+			Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
+			CreateSection(LODIndex, SectionId, Properties);
+		}
+	}
+	return true;
 }
 
 void UNoxelRMCProvider::MarkCacheDirty()
@@ -318,62 +609,158 @@ void UNoxelRMCProvider::MarkCacheDirty()
 	bIsCacheDirty = true;
 }
 
-bool UNoxelRMCProvider::GetCachedData(TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData)
+void UNoxelRMCProvider::MarkCachedPanelsDirty(const TSet<int32>& InPanels)
+{
+	FRWScopeLock Lock(CacheSyncRoot, FRWScopeLockType::SLT_Write);
+	DirtyCachedPanels.Append(InPanels);
+}
+
+bool UNoxelRMCProvider::GetCachedData(const TArray<int32>& PanelIndices, TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData)
 {
 	FRWScopeLock Lock(CacheSyncRoot, FRWScopeLockType::SLT_ReadOnly);
-	OutIntersectionData = CachedIntersectionData;
-	return !bIsCacheDirty;
+	OutIntersectionData.Reset(PanelIndices.Num());
+	for (int32 PanelIdx : PanelIndices)
+	{
+		if (!CachedIntersectionData.IsValidIndex(PanelIdx))
+		{
+			return false;
+		}
+		OutIntersectionData.Add(CachedIntersectionData[PanelIdx]);
+	}
+	return !bIsCacheDirty && DirtyCachedPanels.Num() == 0;
 }
 
 void UNoxelRMCProvider::MakeCacheIfDirty()
 {
-	TArray<FNoxelRendererBakedIntersectionData> IntersectionData;
-	if (GetCachedData(IntersectionData))
+	SCOPE_CYCLE_COUNTER(STAT_NoxelMakeCache);
+	//Only one rebuild at a time, so that a concurrent call doesn't see the cache as clean while it's being rebuilt
+	FScopeLock BuildLock(&CacheBuildSyncRoot);
+	bool bRebuildAll;
+	TSet<int32> PanelsToRebuild;
 	{
-		//Cache is good, nothing to do
-		return;
+		FRWScopeLock Lock(CacheSyncRoot, FRWScopeLockType::SLT_Write);
+		if (!bIsCacheDirty && DirtyCachedPanels.Num() == 0)
+		{
+			//Cache is good, nothing to do
+			return;
+		}
+		//Panels marked dirty past this point will be rebuilt on the next call
+		bRebuildAll = bIsCacheDirty;
+		PanelsToRebuild = MoveTemp(DirtyCachedPanels);
+		DirtyCachedPanels.Reset();
+		bIsCacheDirty = false;
 	}
 
 	//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Rebuilding cache"));
-	//Past this point, cache is dirty
 
-	TArray<FVector> TempNodes;
-	TArray<FNoxelRendererPanelData> TempPanels;
-	GetShapeParams(TempNodes, TempPanels);
+	const FNoxelRendererShapeRef TempShape = GetShape();
+	const TArray<FVector>& TempNodes = TempShape->Nodes;
+	const TArray<FNoxelRendererPanelData>& TempPanels = TempShape->Panels;
 	int32 NumPanels = TempPanels.Num();
 
-	TArray<FNoxelRendererBakedIntersectionData> AllPanelsIntersections;
+	TArray<int32> PanelIndices; //Index in TempPanels of the panels to rebuild
+	if (bRebuildAll)
+	{
+		PanelIndices.Reserve(NumPanels);
+		for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
+		{
+			PanelIndices.Add(PanelIdx);
+		}
+	}
+	else
+	{
+		PanelIndices.Reserve(PanelsToRebuild.Num());
+		for (int32 PanelIdx : PanelsToRebuild)
+		{
+			if (PanelIdx < NumPanels)
+			{
+				PanelIndices.Add(PanelIdx);
+			}
+		}
+	}
 
+	TArray<FNoxelRendererBakedIntersectionData> BakedIntersections;
+	BakeIntersections(TempNodes, TempPanels, PanelIndices, BakedIntersections);
+	INC_DWORD_STAT_BY(STAT_NoxelRecomputedPanels, PanelIndices.Num());
+
+	FRWScopeLock Lock(CacheSyncRoot, FRWScopeLockType::SLT_Write);
+	CachedIntersectionData.SetNum(NumPanels);
+	for (int32 i = 0; i < PanelIndices.Num(); i++)
+	{
+		CachedIntersectionData[PanelIndices[i]] = MoveTemp(BakedIntersections[i]);
+	}
+}
+
+void UNoxelRMCProvider::BakeIntersections(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels, const TArray<int32>& PanelIndices,
+	TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData, bool bParallel)
+{
+	//Panels only read the shared snapshot and write their own output slot, so batches can run on any thread
+	const int32 NumToBake = PanelIndices.Num();
+	OutIntersectionData.SetNum(NumToBake);
+	const int32 NumBatches = FMath::DivideAndRoundUp(NumToBake, INTERSECTION_BAKE_BATCH_SIZE);
+	ParallelFor(NumBatches, [&](int32 BatchIdx)
+	{
+		FNoxelIntersectionScratch Scratch;
+		const int32 BatchEnd = FMath::Min((BatchIdx + 1) * INTERSECTION_BAKE_BATCH_SIZE, NumToBake);
+		for (int32 i = BatchIdx * INTERSECTION_BAKE_BATCH_SIZE; i < BatchEnd; i++)
+		{
+			BakePanelIntersections(TempNodes, TempPanels, PanelIndices[i], OutIntersectionData[i], Scratch);
+		}
+	}, !bParallel || NumBatches < 2);
+}
+
+void UNoxelRMCProvider::BakePanelIntersections(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels, int32 PanelIdx,
+	FNoxelRendererBakedIntersectionData& OutIntersectionData, FNoxelIntersectionScratch& Scratch)
+{
 	//At this point, nodes should be in the correct order (TODO)
 	//AdjacentPanels should be filled
 	//Center should be filled
-	for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
-	{
-	FNoxelRendererPanelData Panel = TempPanels[PanelIdx];
+	const FNoxelRendererPanelData& Panel = TempPanels[PanelIdx];
 	int32 NumNodes = Panel.Nodes.Num();
-		//Compute adjacency
-		TArray<FNoxelRendererAdjacencyData> ThisPanelAdjacency; //node0 top then bottom then node1 top then bottom...
-		ThisPanelAdjacency.Reserve(NumNodes * 2);
-		for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
-		{
-			int32 Node = Panel.Nodes[NodeIdx];
-			FVector NodePos = TempNodes[Node];
-			int32 NextNode = Panel.Nodes[(NodeIdx + 1) % NumNodes];
-			FVector NextNodePos = TempNodes[NextNode];
-			FVector SideDirection = NextNodePos - NodePos;
-			FVector Normal = ((NodePos - Panel.Center) ^ (NextNodePos - Panel.Center)).GetSafeNormal();
-			FVector Zdir = SideDirection.GetSafeNormal();
-			FVector Xdir = (UKismetMathLibrary::ProjectPointOnToPlane(Panel.Center, NodePos, Zdir) - NodePos).GetSafeNormal();
-			FVector Ydir = Zdir ^ Xdir;
-			if ((Ydir | Panel.Normal) < 0.f)
+	const bool bHasSideAdjacency = Panel.SideAdjacencyOffsets.Num() == NumNodes + 1;
+	//Compute adjacency
+	TArray<FNoxelRendererAdjacencyData>& ThisPanelAdjacency = Scratch.PanelAdjacency; //node0 top then bottom then node1 top then bottom...
+	ThisPanelAdjacency.Reset(NumNodes * 2);
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		int32 Node = Panel.Nodes[NodeIdx];
+		FVector NodePos = TempNodes[Node];
+		int32 NextNode = Panel.Nodes[(NodeIdx + 1) % NumNodes];
+		FVector NextNodePos = TempNodes[NextNode];
+		FVector SideDirection = NextNodePos - NodePos;
+		FVector Normal = ((NodePos - Panel.Center) ^ (NextNodePos - Panel.Center)).GetSafeNormal();
+		FVector Zdir = SideDirection.GetSafeNormal();
+		FVector Xdir = (UKismetMathLibrary::ProjectPointOnToPlane(Panel.Center, NodePos, Zdir) - NodePos).GetSafeNormal();
+		FVector Ydir = Zdir ^ Xdir;
+		if ((Ydir | Panel.Normal) < 0.f)
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Flipping Y coord for side %i of panel number %i"), NodeIdx, PanelIdx);
+			Ydir = -Ydir;
+		}
+		TArray<AngleIndexPair>& PanelCandidates = Scratch.PanelCandidates; //Index is panel index the TempPanels
+		PanelCandidates.Reset();
+		auto AddCandidate = [&](const int32 OtherPanelIdx)
+		{
+			FVector relativecenter = TempPanels[OtherPanelIdx].Center - NodePos;
+			float X = relativecenter | Xdir;
+			float Y = relativecenter | Ydir;
+			float angle = FMath::Atan2(Y, -X);
+			PanelCandidates.Emplace(angle, OtherPanelIdx);
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Other panel at index %i is usable for side %i of panel number %i; angle = %f"), OtherPanelIdx, NodeIdx, PanelIdx, angle);
+		};
+		if (bHasSideAdjacency)
+		{
+			//The container already knows which panels share this side
+			for (int32 SideAdjIdx = Panel.SideAdjacencyOffsets[NodeIdx]; SideAdjIdx < Panel.SideAdjacencyOffsets[NodeIdx + 1]; SideAdjIdx++)
 			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Flipping Y coord for side %i of panel number %i"), NodeIdx, PanelIdx);
-				Ydir = -Ydir;
+				AddCandidate(Panel.SideAdjacentPanels[SideAdjIdx]);
 			}
-			TArray<AngleIndexPair> PanelCandidates; //Index is panel index the TempPanels
+		}
+		else
+		{
 			for (int32 OtherPanelIdx : Panel.AdjacentPanels)
 			{
-				FNoxelRendererPanelData OtherPanel = TempPanels[OtherPanelIdx];
+				const FNoxelRendererPanelData& OtherPanel = TempPanels[OtherPanelIdx];
 				int32 OtherNumNodes = OtherPanel.Nodes.Num();
 				int32 OtherPanelNodeIdx = OtherPanel.Nodes.Find(Node);
 				if (OtherPanelNodeIdx != INDEX_NONE)
@@ -381,7 +768,6 @@ void UNoxelRMCProvider::MakeCacheIfDirty()
 					bool usable = false;
 					//If the panels are on the same side, normals will be in the same direction
 					//Normals will go clockwise when the side direction is going away from view
-					FVector OtherNormal = ((NodePos - OtherPanel.Center) ^ (NextNodePos - OtherPanel.Center)).GetSafeNormal();
 					if (OtherPanel.Nodes[(OtherPanelNodeIdx + 1) % OtherNumNodes] == NextNode)
 					{
 						//Same order
@@ -394,175 +780,284 @@ void UNoxelRMCProvider::MakeCacheIfDirty()
 					}
 					if (usable)
 					{
-						FVector relativecenter = OtherPanel.Center - NodePos;
-						float X = relativecenter | Xdir;
-						float Y = relativecenter | Ydir;
-						float angle = FMath::Atan2(Y, -X);
-						PanelCandidates.Emplace(angle, OtherPanelIdx);
-						//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Other panel at index %i is usable for side %i of panel number %i; angle = %f"), OtherPanelIdx, NodeIdx, PanelIdx, angle);
+						AddCandidate(OtherPanelIdx);
 					}
 				}
 			}
-			if (PanelCandidates.Num() == 0)
-			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Found no adjacent panels for side %i of panel number %i"), NodeIdx, PanelIdx);
-				ThisPanelAdjacency.Emplace(Xdir, NodePos);
-				ThisPanelAdjacency.Emplace(Xdir, NodePos);
-			}
-			else
+		}
+		if (PanelCandidates.Num() == 0)
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Found no adjacent panels for side %i of panel number %i"), NodeIdx, PanelIdx);
+			ThisPanelAdjacency.Emplace(Xdir, NodePos);
+			ThisPanelAdjacency.Emplace(Xdir, NodePos);
+		}
+		else
+		{
+			PanelCandidates.Sort(); //Sorted ascending
+			//Keep least and most angle closest to 0 for top and bottom respectively
+			//Top should connect with the smallest positive angle, and bottom should connect with the biggest negative angle
+			//TArray<int32> PanelIndices = { PanelCandidates[0].Index, PanelCandidates.Last().Index };
+			const int32 PanelIndices[2] = { PanelCandidates.Last().Index, PanelCandidates[0].Index };
+
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Found %i adjacent panels for side %i of panel number %i, selecting panels %i for top and %i for bottom"), 
+			//	PanelCandidates.Num(), NodeIdx, PanelIdx, PanelIndices[0], PanelIndices[1]);
+			for (int32 PanelIndex : PanelIndices)
 			{
-				PanelCandidates.Sort(); //Sorted ascending
-				//Keep least and most angle closest to 0 for top and bottom respectively
-				//Top should connect with the smallest positive angle, and bottom should connect with the biggest negative angle
-				//TArray<int32> PanelIndices = { PanelCandidates[0].Index, PanelCandidates.Last().Index };
-				TArray<int32> PanelIndices = { PanelCandidates.Last().Index, PanelCandidates[0].Index };
-
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Found %i adjacent panels for side %i of panel number %i, selecting panels %i for top and %i for bottom"), 
-				//	PanelCandidates.Num(), NodeIdx, PanelIdx, PanelIndices[0], PanelIndices[1]);
-				for (int32 PanelIndex : PanelIndices)
+				const FNoxelRendererPanelData& OtherPanel = TempPanels[PanelIndex];
+				FVector Bisector = UKismetMathLibrary::ProjectVectorOnToPlane(Panel.Center - NodePos, Zdir).GetSafeNormal() + UKismetMathLibrary::ProjectVectorOnToPlane(OtherPanel.Center - NodePos, Zdir).GetSafeNormal();
+				if (Bisector.IsNearlyZero())
 				{
-					FNoxelRendererPanelData OtherPanel = TempPanels[PanelIndex];
-					FVector Bisector = UKismetMathLibrary::ProjectVectorOnToPlane(Panel.Center - NodePos, Zdir).GetSafeNormal() + UKismetMathLibrary::ProjectVectorOnToPlane(OtherPanel.Center - NodePos, Zdir).GetSafeNormal();
-					if (Bisector.IsNearlyZero())
-					{
-						Bisector = Normal;
-					}
-					FVector IntersectionNormal = (Bisector ^ SideDirection).GetSafeNormal();
-					//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection between panels %i and other panel %i; Bisector = %s; SideDirection = %s; IntersectionNormal = %s"), 
-					//	PanelIdx, PanelIndex, *Bisector.GetSafeNormal().ToString(), *SideDirection.GetSafeNormal().ToString(), *IntersectionNormal.ToString());
-					ThisPanelAdjacency.Emplace(IntersectionNormal, NodePos);
+					Bisector = Normal;
 				}
+				FVector IntersectionNormal = (Bisector ^ SideDirection).GetSafeNormal();
+				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection between panels %i and other panel %i; Bisector = %s; SideDirection = %s; IntersectionNormal = %s"), 
+				//	PanelIdx, PanelIndex, *Bisector.GetSafeNormal().ToString(), *SideDirection.GetSafeNormal().ToString(), *IntersectionNormal.ToString());
+				ThisPanelAdjacency.Emplace(IntersectionNormal, NodePos);
 			}
 		}
+	}
 
-		TArray<FVector> ThisPanelIntersections;
-		//Compute Intersections
-		for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
-		{
-			int32 Node = Panel.Nodes[NodeIdx];
-			FVector NodePos = TempNodes[Node];
-			int32 NextNodeIdx = (NodeIdx + 1) % NumNodes;
-			int32 NextNode = Panel.Nodes[NextNodeIdx];
-			FVector NextNodePos = TempNodes[NextNode];
-			FVector SideDirection = NextNodePos - NodePos;
-			FVector Normal = Panel.Normal; //((NodePos - Panel.Center) ^ (NextNodePos - Panel.Center)).GetSafeNormal();//wrong normal used
-			FNoxelRendererAdjacencyData PlaneTop = ThisPanelAdjacency[2 * NodeIdx],
-				PlaneTopNext = ThisPanelAdjacency[2 * NextNodeIdx],
-				PlaneBottom = ThisPanelAdjacency[2 * NodeIdx + 1],
-				PlaneBottomNext = ThisPanelAdjacency[2 * NextNodeIdx + 1];
-			FVector IntersectionTop, IntersectionBottom;
-			if (Intersection3Planes(Normal, NextNodePos + Normal * Panel.ThicknessNormal, PlaneTop, PlaneTopNext, IntersectionTop))
-			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection for node %i at normals side happens at location %s"), NextNodeIdx, *IntersectionTop.ToString());
-				ThisPanelIntersections.Add(IntersectionTop);
-			}
-			else
-			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection failed for node %i at normals side"), NextNodeIdx);
-				ThisPanelIntersections.Add(NextNodePos + Normal * Panel.ThicknessNormal);
-			}
-			if (Intersection3Planes(Normal, NextNodePos - Normal * Panel.ThicknessAntiNormal, PlaneBottom, PlaneBottomNext, IntersectionBottom))
-			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection for node %i at antinormals side happens at location %s"), NextNodeIdx, *IntersectionBottom.ToString());
-				ThisPanelIntersections.Add(IntersectionBottom);
-			}
-			else
-			{
-				//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection failed for node %i at antinormals side"), NextNodeIdx);
-				ThisPanelIntersections.Add(NextNodePos - Normal * Panel.ThicknessAntiNormal);
-			}
+	TArray<FVector>& ThisPanelIntersections = OutIntersectionData.Intersections;
+	ThisPanelIntersections.Reset(NumNodes * 2);
+	//Compute Intersections
+	for (int32 NodeIdx = 0; NodeIdx < NumNodes; NodeIdx++)
+	{
+		int32 Node = Panel.Nodes[NodeIdx];
+		FVector NodePos = TempNodes[Node];
+		int32 NextNodeIdx = (NodeIdx + 1) % NumNodes;
+		int32 NextNode = Panel.Nodes[NextNodeIdx];
+		FVector NextNodePos = TempNodes[NextNode];
+		FVector SideDirection = NextNodePos - NodePos;
+		FVector Normal = Panel.Normal; //((NodePos - Panel.Center) ^ (NextNodePos - Panel.Center)).GetSafeNormal();//wrong normal used
+		FNoxelRendererAdjacencyData PlaneTop = ThisPanelAdjacency[2 * NodeIdx],
+			PlaneTopNext = ThisPanelAdjacency[2 * NextNodeIdx],
+			PlaneBottom = ThisPanelAdjacency[2 * NodeIdx + 1],
+			PlaneBottomNext = ThisPanelAdjacency[2 * NextNodeIdx + 1];
+		FVector IntersectionTop, IntersectionBottom;
+		if (Intersection3Planes(Normal, NextNodePos + Normal * Panel.ThicknessNormal, PlaneTop, PlaneTopNext, IntersectionTop))
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection for node %i at normals side happens at location %s"), NextNodeIdx, *IntersectionTop.ToString());
+			ThisPanelIntersections.Add(IntersectionTop);
+		}
+		else
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection failed for node %i at normals side"), NextNodeIdx);
+			ThisPanelIntersections.Add(NextNodePos + Normal * Panel.ThicknessNormal);
+		}
+		if (Intersection3Planes(Normal, NextNodePos - Normal * Panel.ThicknessAntiNormal, PlaneBottom, PlaneBottomNext, IntersectionBottom))
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection for node %i at antinormals side happens at location %s"), NextNodeIdx, *IntersectionBottom.ToString());
+			ThisPanelIntersections.Add(IntersectionBottom);
+		}
+		else
+		{
+			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeCacheIfDirty] Intersection failed for node %i at antinormals side"), NextNodeIdx);
+			ThisPanelIntersections.Add(NextNodePos - Normal * Panel.ThicknessAntiNormal);
 		}
-		AllPanelsIntersections.Emplace(ThisPanelIntersections);
 	}
-
-	FRWScopeLock Lock(CacheSyncRoot, FRWScopeLockType::SLT_Write);
-	CachedIntersectionData = AllPanelsIntersections;
-	bIsCacheDirty = false;
 }
 
-void UNoxelRMCProvider::GetNumIndicesPerSide(int32 LODIndex, int32 & NumVertices, int32 & NumTriangles)
+//Writes the render mesh, with normals, tangents, colors and UVs
+struct FNoxelRenderMeshWriter
 {
-	switch (LODIndex)
+	FRuntimeMeshRenderableMeshData& MeshData;
+	const bool bShareVertices;
+	//Set if a vertex couldn't be given a normal, in which case normals have to be computed from the triangles
+	bool bHasDegenerateNormals;
+	//Vertices of the panel being meshed, panels never share vertices as each has its own intersections
+	TMap<FNoxelVertexKey, int32> PanelVertices;
+
+	FNoxelRenderMeshWriter(FRuntimeMeshRenderableMeshData& InMeshData, const bool bInShareVertices)
+		: MeshData(InMeshData),
+		bShareVertices(bInShareVertices),
+		bHasDegenerateNormals(false)
+	{}
+
+	FORCEINLINE void BeginPanel(const FNoxelRendererPanelData& Panel)
 	{
-	case 0:
-		NumVertices = 12;
-		NumTriangles = 6;
-		break;
-	case 1:
-		NumVertices = 10;
-		NumTriangles = 4;
-		break;
-	case 2:
-		NumVertices = 4;
-		NumTriangles = 2;
-		break;
-	default:
-		NumVertices = 0;
-		NumTriangles = 0;
-		break;
+		PanelVertices.Reset();
 	}
-}
 
-int32 UNoxelRMCProvider::GetNumSides(TArray<FNoxelRendererPanelData>& InPanels)
+	FORCEINLINE int32 AddVertex(const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
+	{
+		if (!bShareVertices)
+		{
+			return AddVertexInternal(InPosition, InNormal, InTangent, InTexCoord);
+		}
+		const FNoxelVertexKey Key(InPosition, InNormal, InTexCoord);
+		if (const int32* ExistingVertIdx = PanelVertices.Find(Key))
+		{
+			return *ExistingVertIdx;
+		}
+		return PanelVertices.Add(Key, AddVertexInternal(InPosition, InNormal, InTangent, InTexCoord));
+	}
+
+	FORCEINLINE void AddTriangle(const int32 A, const int32 B, const int32 C)
+	{
+		MeshData.Triangles.AddTriangle(A, B, C);
+	}
+
+private:
+	FORCEINLINE int32 AddVertexInternal(const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
+	{
+		bHasDegenerateNormals |= InNormal.IsNearlyZero();
+		int32 VertIdx = MeshData.Positions.Add(InPosition);
+		MeshData.Tangents.Add(InNormal, InTangent);
+		MeshData.Colors.Add(FColor::White);
+		MeshData.TexCoords.Add(InTexCoord);
+		return VertIdx;
+	}
+};
+
+//Writes the collision mesh, positions only, and the first triangle of each panel
+struct FNoxelCollisionMeshWriter
 {
-	int32 sum = 0;
-	for (FNoxelRendererPanelData Panel : Panels)
+	FRuntimeMeshCollisionData& CollisionData;
+	TArray<TPair<int32, int32>>& CollisionMap;
+
+	FNoxelCollisionMeshWriter(FRuntimeMeshCollisionData& InCollisionData, TArray<TPair<int32, int32>>& InCollisionMap)
+		: CollisionData(InCollisionData),
+		CollisionMap(InCollisionMap)
+	{}
+
+	FORCEINLINE void BeginPanel(const FNoxelRendererPanelData& Panel)
+	{
+		CollisionMap.Emplace(CollisionData.Triangles.Num(), Panel.PanelIndex);
+	}
+
+	FORCEINLINE int32 AddVertex(const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
 	{
-		sum = sum + Panel.Nodes.Num();
+		return CollisionData.Vertices.Add(InPosition);
 	}
-	return sum;
+
+	FORCEINLINE void AddTriangle(const int32 A, const int32 B, const int32 C)
+	{
+		CollisionData.Triangles.Add(A, B, C);
+	}
+};
+
+//Vertices and triangles MakeMeshForLOD writes for each side of a panel, vertices counted as if none were shared
+static const int32 NumVerticesPerSide[3] = { 12, 10, 4 };
+static const int32 NumTrianglesPerSide[3] = { 6, 4, 2 };
+
+//Counts what MakeMeshForPanels would write from the number of sides only, to reserve the buffers beforehand
+static void CountMeshForPanels(int32 LODIndex, const TArray<FNoxelRendererPanelData>& TempPanels, int32& OutNumVertices, int32& OutNumTriangles)
+{
+	check(LODIndex >= 0 && LODIndex <= 2);
+	int32 NumSides = 0;
+	for (const FNoxelRendererPanelData& Panel : TempPanels)
+	{
+		NumSides += Panel.Nodes.Num();
+	}
+	OutNumVertices = NumSides * NumVerticesPerSide[LODIndex];
+	OutNumTriangles = NumSides * NumTrianglesPerSide[LODIndex];
 }
 
-void UNoxelRMCProvider::MakeMeshForLOD(int32 LODIndex, int32 SectionId, TArray<FVector>& PanelNodes, FNoxelRendererPanelData& Panel, FNoxelRendererBakedIntersectionData& ThisPanelIntersectionData,
-	TFunction<void(const FVector& InPosition, const FVector2D& InTexCoord)> AddVertex,
-	TFunction<void(const int32 A, const int32 B, const int32 C)> AddTriangle)
+#if !UE_BUILD_SHIPPING
+//Forwards to callbacks, only used to measure the cost of calling through TFunction
+struct FNoxelFunctionMeshWriter
+{
+	TFunction<int32(const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)> AddVertexFunction;
+	TFunction<void(const int32 A, const int32 B, const int32 C)> AddTriangleFunction;
+
+	FORCEINLINE void BeginPanel(const FNoxelRendererPanelData& Panel)
+	{}
+
+	FORCEINLINE int32 AddVertex(const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
+	{
+		return AddVertexFunction(InPosition, InNormal, InTangent, InTexCoord);
+	}
+
+	FORCEINLINE void AddTriangle(const int32 A, const int32 B, const int32 C)
+	{
+		AddTriangleFunction(A, B, C);
+	}
+};
+#endif
+
+//Makes the mesh for a single panel
+//PanelNodes is an array where Panel.Nodes[i]'s location is stored in PanelNodes[i]
+//Writer.AddVertex returns the index of the vertex in the mesh, which Writer.AddTriangle then receives
+template<int32 LODIndex, typename WriterType>
+static void MakeMeshForLOD(const TArray<FVector>& PanelNodes, const FNoxelRendererPanelData& Panel, const FNoxelRendererBakedIntersectionData& ThisPanelIntersectionData, WriterType& Writer)
 {
+	static_assert(LODIndex >= 0 && LODIndex <= 2, "Noxel meshes only have 3 LODs");
 	int32 NumNodes = Panel.Nodes.Num();
 	FVector CenterTop = Panel.Center + Panel.Normal * Panel.ThicknessNormal;
 	FVector CenterBottom = Panel.Center - Panel.Normal * Panel.ThicknessAntiNormal;
-	//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::MakeMeshForLOD] Panel center = %s; Panel normal = %s;"), *Panel.Center.ToString(), *Panel.Normal.ToString());
-	int32 NumVertsPerSide, NumTrianglesPerSide;
-	GetNumIndicesPerSide(LODIndex, NumVertsPerSide, NumTrianglesPerSide);
+	//UE_LOG(NoxelRendererLog, Log, TEXT("[MakeMeshForLOD] Panel center = %s; Panel normal = %s;"), *Panel.Center.ToString(), *Panel.Normal.ToString());
+	const TArray<FVector>& ThisPanelIntersections = ThisPanelIntersectionData.Intersections;
 
 	for (int32 i = 0; i < NumNodes; i++)
 	{
 		int32 NodeIdx = (i + 1) % NumNodes;
-		int32 Node = Panel.Nodes[NodeIdx];
 		FVector NodePos = PanelNodes[NodeIdx];
 		int32 NextNodeIdx = (NodeIdx + 1) % NumNodes;
-		int32 NextNode = Panel.Nodes[NextNodeIdx];
 		FVector NextNodePos = PanelNodes[NextNodeIdx];
 
-		int32 VertIndex0 = NumVertsPerSide * i; //Offset per edge
+		//Normals and tangents are known from the geometry, tangents follow the direction in which U grows
+		//Outwards normal of the side, used as is where the edge isn't mitered
+		FVector SideNormal = ((NextNodePos - NodePos) ^ Panel.Normal).GetSafeNormal();
+		if ((SideNormal | (NodePos - Panel.Center)) < 0.f)
+		{
+			SideNormal = -SideNormal;
+		}
+		const FVector SideTangent = (NodePos - NextNodePos).GetSafeNormal();
+		const FVector TopTangent = FVector::VectorPlaneProject(NodePos - Panel.Center, Panel.Normal).GetSafeNormal();
+		const FVector BottomTangent = FVector::VectorPlaneProject(Panel.Center - NextNodePos, Panel.Normal).GetSafeNormal();
+		//Normal of a quad of the edge, from its diagonals, facing outwards
+		auto QuadNormal = [&](const FVector& A, const FVector& B, const FVector& C, const FVector& D)
+		{
+			FVector QuadNormal = ((C - A) ^ (D - B)).GetSafeNormal();
+			return (QuadNormal | SideNormal) < 0.f ? -QuadNormal : QuadNormal;
+		};
 
+		int32 SideVerts[12]; //Index in the mesh of the vertices of this side, numbered as below
+		int32 NumSideVerts = 0;
+		auto AddVertexInternal = [&](const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
+		{
+			SideVerts[NumSideVerts++] = Writer.AddVertex(InPosition, InNormal, InTangent, InTexCoord);
+		};
 		auto AddTriangleInternal = [&](const int32 A, const int32 B, const int32 C)
 		{
-			AddTriangle(A + VertIndex0, B + VertIndex0, C + VertIndex0);
+			Writer.AddTriangle(SideVerts[A], SideVerts[B], SideVerts[C]);
 		};
 
-		AddVertex(CenterTop, FVector2D(0, 0));//0
-		AddVertex(CenterBottom, FVector2D(1, 1));//1
+		AddVertexInternal(CenterTop, Panel.Normal, TopTangent, FVector2D(0, 0));//0
+		AddVertexInternal(CenterBottom, -Panel.Normal, BottomTangent, FVector2D(1, 1));//1
 		float epsilonup = 0.1f, epsilondown = 0.1f;
 		//TODO : conserve angles from center
+		FVector EdgeTopNormal = SideNormal, EdgeBottomNormal = SideNormal;
 		if (LODIndex == 0 || LODIndex == 1)
 		{
-			TArray<FVector> ThisPanelIntersections = ThisPanelIntersectionData.Intersections;
+			const FVector& TopFirst = ThisPanelIntersections[2 * i], & TopNext = ThisPanelIntersections[2 * (NodeIdx)],
+				& BottomFirst = ThisPanelIntersections[2 * i + 1], & BottomNext = ThisPanelIntersections[2 * (NodeIdx)+1];
 			//Only for the faces
-			AddVertex(ThisPanelIntersections[2 * i], FVector2D(1 - epsilonup, 0));//2 Top first
-			AddVertex(ThisPanelIntersections[2 * (NodeIdx)], FVector2D(0, 1 - epsilonup));//3 //Top next
-			AddVertex(ThisPanelIntersections[2 * i + 1], FVector2D(1, epsilondown));//4 //Bottom first
-			AddVertex(ThisPanelIntersections[2 * (NodeIdx)+1], FVector2D(epsilondown, 1));//5 //Bottom next
+			AddVertexInternal(TopFirst, Panel.Normal, TopTangent, FVector2D(1 - epsilonup, 0));//2 Top first
+			AddVertexInternal(TopNext, Panel.Normal, TopTangent, FVector2D(0, 1 - epsilonup));//3 //Top next
+			AddVertexInternal(BottomFirst, -Panel.Normal, BottomTangent, FVector2D(1, epsilondown));//4 //Bottom first
+			AddVertexInternal(BottomNext, -Panel.Normal, BottomTangent, FVector2D(epsilondown, 1));//5 //Bottom next
 
 			//Only for the edge
-			AddVertex(ThisPanelIntersections[2 * i], FVector2D(1 - epsilonup, 0));//6 Top first
-			AddVertex(ThisPanelIntersections[2 * (NodeIdx)], FVector2D(0, 1 - epsilonup));//7 //Top next
-			AddVertex(ThisPanelIntersections[2 * i + 1], FVector2D(1, epsilondown));//8 //Bottom first
-			AddVertex(ThisPanelIntersections[2 * (NodeIdx)+1], FVector2D(epsilondown, 1));//9 //Bottom next
+			//At LOD0 the edge is folded along the nodes, at LOD1 it's a single quad
+			EdgeTopNormal = LODIndex == 0 ? QuadNormal(TopFirst, TopNext, NextNodePos, NodePos) : QuadNormal(TopFirst, TopNext, BottomNext, BottomFirst);
+			EdgeBottomNormal = LODIndex == 0 ? QuadNormal(NodePos, NextNodePos, BottomNext, BottomFirst) : EdgeTopNormal;
+			AddVertexInternal(TopFirst, EdgeTopNormal, SideTangent, FVector2D(1 - epsilonup, 0));//6 Top first
+			AddVertexInternal(TopNext, EdgeTopNormal, SideTangent, FVector2D(0, 1 - epsilonup));//7 //Top next
+			AddVertexInternal(BottomFirst, EdgeBottomNormal, SideTangent, FVector2D(1, epsilondown));//8 //Bottom first
+			AddVertexInternal(BottomNext, EdgeBottomNormal, SideTangent, FVector2D(epsilondown, 1));//9 //Bottom next
 		}
-		if (LODIndex == 0 || LODIndex == 2)
+		if (LODIndex == 0)
 		{
-			AddVertex(NodePos, FVector2D(1 - epsilonup / 2.f, epsilondown / 2.f));//2 or 10
-			AddVertex(NextNodePos, FVector2D(epsilonup / 2.f, 1 - epsilondown / 2.f));// 3 or 11
+			//The nodes are shared by both halves of the edge
+			const FVector NodeNormal = (EdgeTopNormal + EdgeBottomNormal).GetSafeNormal();
+			AddVertexInternal(NodePos, NodeNormal, SideTangent, FVector2D(1 - epsilonup / 2.f, epsilondown / 2.f));//10
+			AddVertexInternal(NextNodePos, NodeNormal, SideTangent, FVector2D(epsilonup / 2.f, 1 - epsilondown / 2.f));//11
+		}
+		if (LODIndex == 2)
+		{
+			AddVertexInternal(NodePos, SideNormal, SideTangent, FVector2D(1 - epsilonup / 2.f, epsilondown / 2.f));//2
+			AddVertexInternal(NextNodePos, SideNormal, SideTangent, FVector2D(epsilonup / 2.f, 1 - epsilondown / 2.f));//3
 		}
 		if (LODIndex == 0)
 		{
@@ -588,8 +1083,112 @@ void UNoxelRMCProvider::MakeMeshForLOD(int32 LODIndex, int32 SectionId, TArray<F
 	}
 }
 
+//Makes the mesh of all the panels, AllPanelsIntersections is only read for LODs 0 and 1
+template<int32 LODIndex, typename WriterType>
+static void MakeMeshForPanels(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+	const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, WriterType& Writer)
+{
+	//At this point, nodes should be in the correct order (TODO)
+	//AdjacentPanels should be filled
+	//Center should be filled
+	const FNoxelRendererBakedIntersectionData NoIntersections;
+	TArray<FVector> PanelNodes;
+	for (int32 PanelIdx = 0; PanelIdx < TempPanels.Num(); PanelIdx++)
+	{
+		const FNoxelRendererPanelData& Panel = TempPanels[PanelIdx];
+		//UE_LOG(NoxelRendererLog, Log, TEXT("[MakeMeshForPanels] Now meshing panel number %i, with PanelIndex = %i"), PanelIdx, Panel.PanelIndex);
+		PanelNodes.Reset(Panel.Nodes.Num());
+		for (int32 NodeIdx : Panel.Nodes)
+		{
+			PanelNodes.Add(TempNodes[NodeIdx]);
+		}
+		Writer.BeginPanel(Panel);
+		MakeMeshForLOD<LODIndex>(PanelNodes, Panel, LODIndex <= 1 ? AllPanelsIntersections[PanelIdx] : NoIntersections, Writer);
+	}
+}
+
+template<typename WriterType>
+static void MakeMeshForPanels(int32 LODIndex, const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+	const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, WriterType& Writer)
+{
+	switch (LODIndex)
+	{
+	case 0:
+		MakeMeshForPanels<0>(TempNodes, TempPanels, AllPanelsIntersections, Writer);
+		break;
+	case 1:
+		MakeMeshForPanels<1>(TempNodes, TempPanels, AllPanelsIntersections, Writer);
+		break;
+	case 2:
+		MakeMeshForPanels<2>(TempNodes, TempPanels, AllPanelsIntersections, Writer);
+		break;
+	default:
+		break;
+	}
+}
+
+//Reserves the render mesh and sets its index size from an exact count of the vertices written without sharing
+static void ReserveRenderMesh(int32 LODIndex, const TArray<FNoxelRendererPanelData>& TempPanels, FRuntimeMeshRenderableMeshData& MeshData)
+{
+	int32 NumVertices, NumTriangles;
+	CountMeshForPanels(LODIndex, TempPanels, NumVertices, NumTriangles);
+	MeshData.Triangles = FRuntimeMeshTriangleStream(NumVertices > (1 << 16)); //Switch to 32 bit if needed
+	MeshData.ReserveVertices(NumVertices);
+	MeshData.Triangles.Reserve(NumTriangles * 3);
+}
+
+void UNoxelRMCProvider::BuildSectionMesh(int32 LODIndex, const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+	const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, FRuntimeMeshRenderableMeshData& MeshData, bool bShareVertices, bool bAnalyticNormals)
+{
+	ReserveRenderMesh(LODIndex, TempPanels, MeshData);
+	FNoxelRenderMeshWriter Writer(MeshData, bShareVertices);
+	MakeMeshForPanels(LODIndex, TempNodes, TempPanels, AllPanelsIntersections, Writer);
+
+	if (!bAnalyticNormals || Writer.bHasDegenerateNormals)
+	{
+		//Fallback for degenerate panels, recomputes the whole section from the triangles
+		URuntimeMeshModifierNormals::CalculateNormalsTangents(MeshData, false);
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+void UNoxelRMCProvider::BuildSectionMeshWithCallbacks(int32 LODIndex, const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+	const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, FRuntimeMeshRenderableMeshData& MeshData)
+{
+	ReserveRenderMesh(LODIndex, TempPanels, MeshData);
+	FNoxelFunctionMeshWriter Writer;
+	Writer.AddVertexFunction = [&](const FVector& InPosition, const FVector& InNormal, const FVector& InTangent, const FVector2D& InTexCoord)
+	{
+		int32 VertIdx = MeshData.Positions.Add(InPosition);
+		MeshData.Tangents.Add(InNormal, InTangent);
+		MeshData.Colors.Add(FColor::White);
+		MeshData.TexCoords.Add(InTexCoord);
+		return VertIdx;
+	};
+	Writer.AddTriangleFunction = [&](const int32 A, const int32 B, const int32 C)
+	{
+		MeshData.Triangles.AddTriangle(A, B, C);
+	};
+	MakeMeshForPanels(LODIndex, TempNodes, TempPanels, AllPanelsIntersections, Writer);
+}
+#endif
+
 void UNoxelRMCProvider::Initialize()
 {
+	if (IsCollisionOnly())
+	{
+		//A single LOD without any section, the mesh only exists for its collision
+		FRuntimeMeshLODProperties LODProperties;
+		LODProperties.ScreenSize = 0.f;
+		ConfigureLODs({ LODProperties });
+		{
+			FScopeLock Lock(&PropertySyncRoot);
+			NumCreatedSections = 0; //Marks the provider as initialized, no section will ever be created
+		}
+		MarkCollisionDirty();
+		return;
+	}
+
 	FRuntimeMeshLODProperties LOD0Properties, LOD1Properties, LOD2Properties;
 	LOD0Properties.ScreenSize = 1.f;
 	LOD1Properties.ScreenSize = 0.4f;
@@ -599,15 +1198,11 @@ void UNoxelRMCProvider::Initialize()
 
 	SetupMaterialSlot(0, FName("Noxel"), GetNoxelMaterial());
 
-	for (int32 LODIndex = 0; LODIndex < 3; LODIndex++)
 	{
-		FRuntimeMeshSectionProperties Properties;
-		Properties.bCastsShadow = true;
-		Properties.bIsVisible = true;
-		Properties.MaterialSlot = 0;
-		Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
-		CreateSection(LODIndex, 0, Properties);
+		FScopeLock Lock(&PropertySyncRoot);
+		NumCreatedSections = 0;
 	}
+	CreateMissingSections();
 	MarkCacheDirty();
 	MarkAllLODsDirty();
 	MarkCollisionDirty();
@@ -615,8 +1210,9 @@ void UNoxelRMCProvider::Initialize()
 
 FBoxSphereBounds UNoxelRMCProvider::GetBounds()
 {
+	const FNoxelRendererShapeRef TempShape = GetShape();
 	float MaxThickness = 0.0f;
-	for (FNoxelRendererPanelData panel : Panels)
+	for (const FNoxelRendererPanelData& panel : TempShape->Panels)
 	{
 		if (panel.ThicknessNormal > MaxThickness)
 		{
@@ -627,18 +1223,23 @@ FBoxSphereBounds UNoxelRMCProvider::GetBounds()
 			MaxThickness = panel.ThicknessAntiNormal;
 		}
 	}
-	FBoxSphereBounds NodesBox(Nodes);
+	FBoxSphereBounds NodesBox(TempShape->Nodes);
 	NodesBox.BoxExtent = NodesBox.BoxExtent + FVector::OneVector * MaxThickness;
 	NodesBox.SphereRadius = NodesBox.SphereRadius + MaxThickness;
 	return NodesBox;
 }
 
 bool UNoxelRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData)
-{	// We should only ever be queried for section 0
-	check(SectionId == 0 && LODIndex <= 2);
-	TArray<FVector> TempNodes;
+{
+	check(LODIndex <= 2);
+	if (IsCollisionOnly())
+	{
+		return false;
+	}
 	TArray<FNoxelRendererPanelData> TempPanels;
-	GetShapeParams(TempNodes, TempPanels);
+	TArray<int32> PanelIndices;
+	const FNoxelRendererShapeRef TempShape = GetSectionShapeParams(SectionId, TempPanels, PanelIndices);
+	const TArray<FVector>& TempNodes = TempShape->Nodes;
 	int32 NumPanels = TempPanels.Num();
 	if (NumPanels == 0)
 	{
@@ -650,166 +1251,231 @@ bool UNoxelRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FR
 	{
 		//Cached intersections
 		MakeCacheIfDirty();
-		if (!GetCachedData(AllPanelsIntersections))
+		if (!GetCachedData(PanelIndices, AllPanelsIntersections))
 		{
 			UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::GetSectionMeshForLOD] Getting cached data failed"));
 			return false; //something went wrong, cache is still dirty
 		}
+		for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
+		{
+			if (AllPanelsIntersections[PanelIdx].Intersections.Num() != TempPanels[PanelIdx].Nodes.Num() * 2)
+			{
+				//Panels changed since they were copied, the section has already been marked dirty again
+				return false;
+			}
+		}
 	}
-	int32 NumSides = GetNumSides(TempPanels);
-	int32 NumVertsPerSide, NumTrianglesPerSide;
-	GetNumIndicesPerSide(LODIndex, NumVertsPerSide, NumTrianglesPerSide);
-	int32 NumVerts = NumSides * NumVertsPerSide;
-	MeshData.Triangles = FRuntimeMeshTriangleStream(NumVerts > (1 << 16)); //Switch to 32 bit if needed
-	MeshData.ReserveVertices(NumVerts);
-	MeshData.Triangles.Reserve(NumSides * NumTrianglesPerSide * 3);
+	BuildSectionMesh(LODIndex, TempNodes, TempPanels, AllPanelsIntersections, MeshData);
 
-	//At this point, nodes should be in the correct order (TODO)
-	//AdjacentPanels should be filled
-	//Center should be filled
-	for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
-	{
-		FNoxelRendererPanelData Panel = TempPanels[PanelIdx];
-		int32 NumNodes = Panel.Nodes.Num();
+	return true;
+}
 
-		//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::GetSectionMeshForLOD] Now rendering panel number %i, with PanelIndex = %i"), PanelIdx, Panel.PanelIndex);
-		//meshing
+FRuntimeMeshCollisionSettings UNoxelRMCProvider::GetCollisionSettings()
+{
+	const FNoxelRendererShapeRef TempShape = GetShape();
+	FRuntimeMeshCollisionSettings Settings;
+	Settings.bUseAsyncCooking = true;
+	Settings.bUseComplexAsSimple = false;
 
-		int32 VertIndex0 = MeshData.Positions.Num(); //Offset per panel
-		auto AddVertex = [&](const FVector& InPosition, const FVector2D& InTexCoord)
+	//FlushPersistentDebugLines(GetWorld());
+	BuildCollisionConvexes(TempShape->Nodes, TempShape->Panels, GetCollisionSimplification(), Settings.ConvexElements);
+	return Settings;
+}
+
+//Replaces Points by their convex hull, in counter clockwise order, and returns its area
+static float ConvexHull2D(TArray<FVector2D>& Points)
+{
+	Points.Sort([](const FVector2D& A, const FVector2D& B)
+	{
+		return A.X < B.X || (A.X == B.X && A.Y < B.Y);
+	});
+	const int32 NumPoints = Points.Num();
+	if (NumPoints < 3)
+	{
+		return 0.f;
+	}
+	//Andrew's monotone chain, lower hull then upper hull
+	TArray<FVector2D> Hull;
+	Hull.Reserve(NumPoints + 1);
+	for (int32 Pass = 0; Pass < 2; Pass++)
+	{
+		const int32 HullStart = Hull.Num();
+		for (int32 i = 0; i < NumPoints; i++)
 		{
-			int32 VertIdx = MeshData.Positions.Add(InPosition);
-			MeshData.Tangents.Add(FVector::ZeroVector, FVector::ZeroVector);
-			MeshData.Colors.Add(FColor::White);
-			MeshData.TexCoords.Add(InTexCoord);
-			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::GetSectionMeshForLOD] Adding a vertex at index %i with position %s and UV %s"), VertIdx, *InPosition.ToString(), *InTexCoord.ToString());
-		};
-		auto AddTriangle = [&](const int32 A, const int32 B, const int32 C)
+			const FVector2D& Point = Points[Pass == 0 ? i : NumPoints - 1 - i];
+			while (Hull.Num() >= HullStart + 2 && FVector2D::CrossProduct(Hull.Last() - Hull.Last(1), Point - Hull.Last(1)) <= 0.f)
+			{
+				Hull.Pop(false);
+			}
+			Hull.Add(Point);
+		}
+		Hull.Pop(false); //Last point is the first of the other half
+	}
+	float DoubleArea = 0.f;
+	for (int32 i = 0; i < Hull.Num(); i++)
+	{
+		DoubleArea += FVector2D::CrossProduct(Hull[i], Hull[(i + 1) % Hull.Num()]);
+	}
+	Points = MoveTemp(Hull);
+	return DoubleArea / 2.f;
+}
+
+void UNoxelRMCProvider::BuildCollisionConvexes(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+	const FNoxelCollisionSimplificationSettings& Simplification, TArray<FRuntimeMeshCollisionConvexMesh>& OutConvexElems)
+{
+	const int32 NumPanels = TempPanels.Num();
+	OutConvexElems.Reserve(NumPanels);
+	const float MinAlignment = FMath::Cos(FMath::DegreesToRadians(Simplification.MaxAngle));
+
+	TArray<bool> IsInElement;
+	IsInElement.Init(false, NumPanels);
+	TArray<int32> Candidates;
+	TSet<int32> TestedCandidates;
+	TArray<FVector2D> ElementHull, TestHull;
+	for (int32 SeedIdx = 0; SeedIdx < NumPanels; SeedIdx++)
+	{
+		if (IsInElement[SeedIdx])
+		{
+			continue;
+		}
+		IsInElement[SeedIdx] = true;
+		const FNoxelRendererPanelData& Seed = TempPanels[SeedIdx];
+
+		//Grow the element from the seed through adjacent panels lying in the same slab, as long as their hull stays filled
+		int32 NumMergedPanels = 1;
+		FVector AxisX, AxisY;
+		Seed.Normal.FindBestAxisVectors(AxisX, AxisY);
+		auto ToPlane = [&](const FVector& Location)
 		{
-			//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::GetSectionMeshForLOD] Adding a triangle with indices %i, %i and %i"), A + VertIndex0, B + VertIndex0, C + VertIndex0);
-			MeshData.Triangles.AddTriangle(A + VertIndex0, B + VertIndex0, C + VertIndex0);
+			const FVector Relative = Location - Seed.Center;
+			return FVector2D(Relative | AxisX, Relative | AxisY);
 		};
-		TArray<FVector> PanelNodes;
-		PanelNodes.Reserve(NumNodes);
-		for (int32 NodeIdx : Panel.Nodes)
+		if (Simplification.bMergePanels)
 		{
-			PanelNodes.Add(TempNodes[NodeIdx]);
+			ElementHull.Reset();
+			for (int32 Node : Seed.Nodes)
+			{
+				ElementHull.Add(ToPlane(TempNodes[Node]));
+			}
+			float PanelsArea = Seed.Area;
+			Candidates.Reset();
+			Candidates.Append(Seed.AdjacentPanels);
+			TestedCandidates.Reset();
+			while (Candidates.Num() > 0 && NumMergedPanels < Simplification.MaxPanelsPerElement)
+			{
+				const int32 CandidateIdx = Candidates.Pop(false);
+				if (IsInElement[CandidateIdx] || TestedCandidates.Contains(CandidateIdx))
+				{
+					continue;
+				}
+				TestedCandidates.Add(CandidateIdx);
+				const FNoxelRendererPanelData& Candidate = TempPanels[CandidateIdx];
+				const float Alignment = Candidate.Normal | Seed.Normal;
+				if (FMath::Abs(Alignment) < MinAlignment
+					|| FMath::Abs((Candidate.Center - Seed.Center) | Seed.Normal) > Simplification.MaxDistance)
+				{
+					continue;
+				}
+				//Flipped panels have their thicknesses swapped
+				const float CandidateThicknessNormal = Alignment > 0.f ? Candidate.ThicknessNormal : Candidate.ThicknessAntiNormal;
+				const float CandidateThicknessAntiNormal = Alignment > 0.f ? Candidate.ThicknessAntiNormal : Candidate.ThicknessNormal;
+				if (FMath::Abs(CandidateThicknessNormal - Seed.ThicknessNormal) > Simplification.MaxDistance
+					|| FMath::Abs(CandidateThicknessAntiNormal - Seed.ThicknessAntiNormal) > Simplification.MaxDistance)
+				{
+					continue;
+				}
+				TestHull = ElementHull;
+				for (int32 Node : Candidate.Nodes)
+				{
+					TestHull.Add(ToPlane(TempNodes[Node]));
+				}
+				const float HullArea = ConvexHull2D(TestHull);
+				if (HullArea - (PanelsArea + Candidate.Area) > Simplification.MaxAreaError * HullArea)
+				{
+					continue;
+				}
+				IsInElement[CandidateIdx] = true;
+				NumMergedPanels++;
+				Swap(ElementHull, TestHull);
+				PanelsArea += Candidate.Area;
+				Candidates.Append(Candidate.AdjacentPanels);
+			}
 		}
-		if (LODIndex <= 1)
+
+		TArray<FVector> Points;
+		if (NumMergedPanels == 1)
 		{
-			MakeMeshForLOD(LODIndex, SectionId, PanelNodes, Panel, AllPanelsIntersections[PanelIdx], AddVertex, AddTriangle);
+			Points.Reserve(Seed.Nodes.Num() + 2);
+			Points.Add(Seed.Center + Seed.Normal * Seed.ThicknessNormal);
+			Points.Add(Seed.Center - Seed.Normal * Seed.ThicknessAntiNormal);
+			for (int32 Node : Seed.Nodes)
+			{
+				Points.Add(TempNodes[Node]);
+			}
 		}
 		else
 		{
-			FNoxelRendererBakedIntersectionData Isct;
-			MakeMeshForLOD(LODIndex, SectionId, PanelNodes, Panel, Isct, AddVertex, AddTriangle);
+			//Prism of the hull of the merged panels
+			Points.Reserve(ElementHull.Num() * 2);
+			for (const FVector2D& HullPoint : ElementHull)
+			{
+				const FVector Location = Seed.Center + AxisX * HullPoint.X + AxisY * HullPoint.Y;
+				Points.Add(Location + Seed.Normal * Seed.ThicknessNormal);
+				Points.Add(Location - Seed.Normal * Seed.ThicknessAntiNormal);
+			}
 		}
+		OutConvexElems.Emplace(Points);
 	}
-
-	URuntimeMeshModifierNormals::CalculateNormalsTangents(MeshData, false);
-
-	return true;
 }
 
-FRuntimeMeshCollisionSettings UNoxelRMCProvider::GetCollisionSettings()
+FNoxelCollisionSimplificationSettings UNoxelRMCProvider::GetCollisionSimplification() const
 {
-	TArray<FVector> TempNodes;
-	TArray<FNoxelRendererPanelData> TempPanels;
-	GetShapeParams(TempNodes, TempPanels);
-	int NumPanels = TempPanels.Num();
-	FRuntimeMeshCollisionSettings Settings;
-	Settings.bUseAsyncCooking = true;
-	Settings.bUseComplexAsSimple = false;
-
-	TArray<FRuntimeMeshCollisionBox>& CollisionBoxes = Settings.Boxes;
-	CollisionBoxes.Reserve(NumPanels);
+	FScopeLock Lock(&PropertySyncRoot);
+	return CollisionSimplification;
+}
 
-	TArray<FRuntimeMeshCollisionConvexMesh>& ConvexElems = Settings.ConvexElements;
-	ConvexElems.Reserve(NumPanels);
-	//FlushPersistentDebugLines(GetWorld());
-	for (int i = 0; i < NumPanels; ++i)
+void UNoxelRMCProvider::SetCollisionSimplification(const FNoxelCollisionSimplificationSettings& InCollisionSimplification)
+{
 	{
-		FNoxelRendererPanelData& Panel = TempPanels[i];
-		//CollisionBoxes.Add(BoxFit(Panel, TempNodes));
-		TArray<FVector> Points; Points.Reserve(Panel.Nodes.Num()+2);
-		Points.Add(Panel.Center + Panel.Normal*Panel.ThicknessNormal);
-		Points.Add(Panel.Center - Panel.Normal*Panel.ThicknessAntiNormal);
-		for (int j = 0; j < Panel.Nodes.Num(); ++j)
-		{
-			Points.Add(TempNodes[Panel.Nodes[j]]);
-		}
-		ConvexElems.Emplace(Points);
+		FScopeLock Lock(&PropertySyncRoot);
+		CollisionSimplification = InCollisionSimplification;
 	}
-	return Settings;
+	MarkCollisionDirty();
 }
 
 bool UNoxelRMCProvider::HasCollisionMesh()
 {
-	return Panels.Num() != 0;
+	return GetShape()->Panels.Num() != 0;
 }
 
 #define COLLISIONMESH_LOD 2
 
 bool UNoxelRMCProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData)
 {
-	
-
-	TArray<FVector> TempNodes;
-	TArray<FNoxelRendererPanelData> TempPanels;
-	GetShapeParams(TempNodes, TempPanels);
+	const FNoxelRendererShapeRef TempShape = GetShape();
+	const TArray<FVector>& TempNodes = TempShape->Nodes;
+	const TArray<FNoxelRendererPanelData>& TempPanels = TempShape->Panels;
 	int32 NumPanels = TempPanels.Num();
 	if (NumPanels == 0)
 	{
 		return false;
 	}
-	int32 NumSidesAllPanels = GetNumSides(TempPanels);
-	int32 NumVertsPerSide, NumTrianglesPerSide;
-	GetNumIndicesPerSide(COLLISIONMESH_LOD, NumVertsPerSide, NumTrianglesPerSide);
-	CollisionData.ReserveVertices(NumSidesAllPanels * NumVertsPerSide);
-	int32 NumTriangles = NumSidesAllPanels * NumTrianglesPerSide;
+	int32 NumVertices, NumTriangles;
+	CountMeshForPanels(COLLISIONMESH_LOD, TempPanels, NumVertices, NumTriangles);
+	CollisionData.ReserveVertices(NumVertices);
 	CollisionData.Triangles.Reserve(NumTriangles);
 
-	TArray<int32> TempCollisionMap;
-	TempCollisionMap.Reserve(NumTriangles);
-
-	for (int32 PanelIdx = 0; PanelIdx < NumPanels; PanelIdx++)
-	{
-		FNoxelRendererPanelData Panel = TempPanels[PanelIdx];
-		int32 NumNodes = Panel.Nodes.Num();
-		/*UE_LOG(NoxelRendererLog, Log,
-		       TEXT("[UNoxelRMCProvider::GetCollisionMesh] Adding to collision map panel index %d with %d sides"),
-		       Panel.PanelIndex, NumNodes*NumTrianglesPerSide);*/
-		for (int32 i = 0; i < NumNodes*NumTrianglesPerSide; i++)
-		{
-			TempCollisionMap.Add(Panel.PanelIndex);
-		}
-
-		//meshing
-
-		int32 VertIndex0 = CollisionData.Vertices.Num();
-		auto AddVertex = [&](const FVector& InPosition, const FVector2D& InTexCoord)
-		{
-			CollisionData.Vertices.Add(InPosition);
-			CollisionData.TexCoords.Add(0, InTexCoord);
-		};
-		auto AddTriangle = [&](const int32 A, const int32 B, const int32 C)
-		{
-			CollisionData.Triangles.Add(A + VertIndex0, B + VertIndex0, C + VertIndex0);
-		};
-		TArray<FVector> PanelNodes;
-		PanelNodes.Reserve(NumNodes);
-		for (int32 NodeIdx : Panel.Nodes)
-		{
-			PanelNodes.Add(TempNodes[NodeIdx]);
-		}
-		FNoxelRendererBakedIntersectionData Isct;
-		MakeMeshForLOD(COLLISIONMESH_LOD, 0, PanelNodes, Panel, Isct, AddVertex, AddTriangle);
-	}
+	TArray<TPair<int32, int32>> TempCollisionMap;
+	TempCollisionMap.Reserve(NumPanels + 1);
+	FNoxelCollisionMeshWriter Writer(CollisionData, TempCollisionMap);
+	MakeMeshForPanels<COLLISIONMESH_LOD>(TempNodes, TempPanels, {}, Writer);
+	//End of the last panel's range
+	TempCollisionMap.Emplace(CollisionData.Triangles.Num(), INDEX_NONE);
 
 	// Add the single collision section
 	CollisionData.CollisionSources.Emplace(0, CollisionData.Triangles.Num() -1, this, 0, ERuntimeMeshCollisionFaceSourceType::Collision);
 
-	NewCollisionMap = TempCollisionMap;
+	NewCollisionMap = MoveTemp(TempCollisionMap);
 
 	return true;
 }
@@ -817,7 +1483,7 @@ bool UNoxelRMCProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionDat
 void UNoxelRMCProvider::CollisionUpdateCompleted()
 {
 	//UE_LOG(NoxelRendererLog, Log, TEXT("[UNoxelRMCProvider::CollisionUpdateCompleted] CollisionMap updated"));
-	CollisionMap = NewCollisionMap;
+	CollisionMap = MoveTemp(NewCollisionMap);
 }
 
 bool UNoxelRMCProvider::IsThreadSafe()
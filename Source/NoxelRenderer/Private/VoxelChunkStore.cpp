@@ -0,0 +1,403 @@
+//Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+#include "VoxelChunkStore.h"
+
+void FVoxelChunk::FillRange(int32 Start, int32 Count)
+{
+	while (Count > 0)
+	{
+		const int32 Bit = Start & 63;
+		const int32 NumBits = FMath::Min(Count, 64 - Bit);
+		const uint64 Mask = NumBits == 64 ? ~0ull : ((1ull << NumBits) - 1) << Bit;
+		Bits[Start >> 6] |= Mask;
+		Start += NumBits;
+		Count -= NumBits;
+	}
+}
+
+bool FVoxelChunkStore::Add(const FIntVector& Cube)
+{
+	FVoxelChunk& Chunk = Chunks.FindOrAdd(CubeToChunk(Cube));
+	const int32 Index = CubeToLocalIndex(Cube);
+	const uint64 Mask = 1ull << (Index & 63);
+	if (Chunk.Bits[Index >> 6] & Mask)
+	{
+		return false;
+	}
+	Chunk.Bits[Index >> 6] |= Mask;
+	Chunk.NumCubes++;
+	NumCubes++;
+	return true;
+}
+
+bool FVoxelChunkStore::Remove(const FIntVector& Cube)
+{
+	const FIntVector ChunkLocation = CubeToChunk(Cube);
+	FVoxelChunk* Chunk = Chunks.Find(ChunkLocation);
+	if (!Chunk)
+	{
+		return false;
+	}
+	const int32 Index = CubeToLocalIndex(Cube);
+	const uint64 Mask = 1ull << (Index & 63);
+	if (!(Chunk->Bits[Index >> 6] & Mask))
+	{
+		return false;
+	}
+	Chunk->Bits[Index >> 6] &= ~Mask;
+	NumCubes--;
+	if (--Chunk->NumCubes == 0)
+	{
+		Chunks.Remove(ChunkLocation);
+	}
+	return true;
+}
+
+void FVoxelChunkStore::SetChunk(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk)
+{
+	if (const FVoxelChunk* OldChunk = Chunks.Find(ChunkLocation))
+	{
+		NumCubes -= OldChunk->NumCubes;
+	}
+	if (Chunk.NumCubes == 0)
+	{
+		Chunks.Remove(ChunkLocation);
+		return;
+	}
+	Chunks.Add(ChunkLocation, Chunk);
+	NumCubes += Chunk.NumCubes;
+}
+
+void FVoxelChunkStore::Empty()
+{
+	Chunks.Empty();
+	NumCubes = 0;
+}
+
+void FVoxelChunkStore::ToArray(TArray<FIntVector>& OutCubes) const
+{
+	OutCubes.Reset(NumCubes);
+	ForEachCube([&](const FIntVector& Cube)
+	{
+		OutCubes.Add(Cube);
+	});
+}
+
+FBox FVoxelChunkStore::GetBounds() const
+{
+	FBox Bounds(ForceInit);
+	ForEachCube([&](const FIntVector& Cube)
+	{
+		Bounds += FVector(Cube);
+	});
+	return Bounds;
+}
+
+FBox FVoxelChunkStore::GetChunksBounds() const
+{
+	FBox Bounds(ForceInit);
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : Chunks)
+	{
+		const FVector ChunkMin = FVector(Chunk.Key * FVoxelChunk::Size);
+		Bounds += ChunkMin;
+		Bounds += ChunkMin + FVector(FVoxelChunk::Size - 1);
+	}
+	return Bounds;
+}
+
+bool FVoxelChunkStore::Raycast(const FVector& Start, const FVector& End, FVoxelRayHit& OutHit) const
+{
+	OutHit = FVoxelRayHit();
+	const FBox ChunksBounds = GetChunksBounds();
+	if (!ChunksBounds.IsValid)
+	{
+		return false;
+	}
+	//Shifted so that cube C spans [C, C+1[ and floor gives the cube
+	const FVector Origin = Start + FVector(0.5f);
+	const FVector Dir = End - Start;
+	const FVector BoxMin = ChunksBounds.Min, BoxMax = ChunksBounds.Max + FVector::OneVector;
+
+	//Clip the segment to the chunks so that the walk never steps through empty space outside of them
+	float TEnter = 0.f, TExit = 1.f;
+	int32 EnterAxis = INDEX_NONE;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		if (FMath::IsNearlyZero(Dir[Axis]))
+		{
+			if (Origin[Axis] < BoxMin[Axis] || Origin[Axis] >= BoxMax[Axis])
+			{
+				return false;
+			}
+			continue;
+		}
+		float T0 = (BoxMin[Axis] - Origin[Axis]) / Dir[Axis];
+		float T1 = (BoxMax[Axis] - Origin[Axis]) / Dir[Axis];
+		if (T0 > T1)
+		{
+			Swap(T0, T1);
+		}
+		if (T0 > TEnter)
+		{
+			TEnter = T0;
+			EnterAxis = Axis;
+		}
+		TExit = FMath::Min(TExit, T1);
+	}
+	if (TEnter > TExit)
+	{
+		return false;
+	}
+
+	const FVector EnterPoint = Origin + Dir * TEnter;
+	FIntVector Cube, Step, Normal = FIntVector::ZeroValue;
+	FVector TMax, TDelta;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		//Clamped as the entry point can land a rounding error outside of the box
+		Cube[Axis] = FMath::Clamp(FMath::FloorToInt(EnterPoint[Axis]), (int32)BoxMin[Axis], (int32)BoxMax[Axis] - 1);
+		if (FMath::IsNearlyZero(Dir[Axis]))
+		{
+			Step[Axis] = 0;
+			TMax[Axis] = BIG_NUMBER;
+			TDelta[Axis] = BIG_NUMBER;
+			continue;
+		}
+		Step[Axis] = Dir[Axis] > 0 ? 1 : -1;
+		const float NextBoundary = Cube[Axis] + (Step[Axis] > 0 ? 1 : 0);
+		TMax[Axis] = (NextBoundary - Origin[Axis]) / Dir[Axis];
+		TDelta[Axis] = FMath::Abs(1.f / Dir[Axis]);
+	}
+	if (EnterAxis != INDEX_NONE)
+	{
+		Normal[EnterAxis] = -Step[EnterAxis];
+	}
+
+	//The chunk is only looked up again when the walk leaves it
+	FIntVector ChunkLocation = CubeToChunk(Cube);
+	const FVoxelChunk* Chunk = Chunks.Find(ChunkLocation);
+	float T = TEnter;
+	while (true)
+	{
+		const FIntVector CubeChunk = CubeToChunk(Cube);
+		if (CubeChunk != ChunkLocation)
+		{
+			ChunkLocation = CubeChunk;
+			Chunk = Chunks.Find(ChunkLocation);
+		}
+		if (Chunk && Chunk->Get(CubeToLocalIndex(Cube)))
+		{
+			OutHit.Cube = Cube;
+			OutHit.Normal = Normal;
+			OutHit.Time = T;
+			OutHit.bHit = true;
+			return true;
+		}
+		const int32 Axis = TMax.X < TMax.Y ? (TMax.X < TMax.Z ? 0 : 2) : (TMax.Y < TMax.Z ? 1 : 2);
+		if (TMax[Axis] > TExit)
+		{
+			return false;
+		}
+		T = TMax[Axis];
+		TMax[Axis] += TDelta[Axis];
+		Cube[Axis] += Step[Axis];
+		Normal = FIntVector::ZeroValue;
+		Normal[Axis] = -Step[Axis];
+	}
+}
+
+static uint32 ZigZagEncode(int32 Value)
+{
+	return ((uint32)Value << 1) ^ (uint32)(Value >> 31);
+}
+
+static int32 ZigZagDecode(uint32 Value)
+{
+	return (int32)(Value >> 1) ^ -(int32)(Value & 1);
+}
+
+static int32 PackedIntSize(uint32 Value)
+{
+	int32 Size = 1;
+	while (Value >= 0x80)
+	{
+		Value >>= 7;
+		Size++;
+	}
+	return Size;
+}
+
+void FVoxelChunkStore::Save(FArchive& Ar) const
+{
+	check(Ar.IsSaving());
+	//Sorted so that consecutive chunks are neighbours and their deltas fit in a byte
+	TArray<FIntVector> Locations;
+	Chunks.GenerateKeyArray(Locations);
+	Locations.Sort([](const FIntVector& A, const FIntVector& B)
+	{
+		return A.Z != B.Z ? A.Z < B.Z : (A.Y != B.Y ? A.Y < B.Y : A.X < B.X);
+	});
+
+	uint32 NumChunks = Locations.Num();
+	Ar.SerializeIntPacked(NumChunks);
+	FIntVector PreviousLocation = FIntVector::ZeroValue;
+	for (const FIntVector& Location : Locations)
+	{
+		const FIntVector Delta = Location - PreviousLocation;
+		PreviousLocation = Location;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			uint32 Coordinate = ZigZagEncode(Delta[Axis]);
+			Ar.SerializeIntPacked(Coordinate);
+		}
+		SaveChunk(Ar, Chunks.FindChecked(Location));
+	}
+}
+
+void FVoxelChunkStore::SaveChunk(FArchive& Ar, const FVoxelChunk& Chunk)
+{
+	check(Ar.IsSaving());
+	//Runs alternate between empty and filled, starting with empty
+	TArray<uint32, TInlineAllocator<64>> Runs;
+	int32 RunsSize = 0;
+	bool bRunFilled = false;
+	uint32 RunLength = 0;
+	for (int32 Index = 0; Index < FVoxelChunk::Size * FVoxelChunk::Size * FVoxelChunk::Size; Index++)
+	{
+		if (Chunk.Get(Index) != bRunFilled)
+		{
+			Runs.Add(RunLength);
+			RunsSize += PackedIntSize(RunLength);
+			bRunFilled = !bRunFilled;
+			RunLength = 0;
+		}
+		RunLength++;
+	}
+	Runs.Add(RunLength);
+	RunsSize += PackedIntSize(RunLength) + PackedIntSize(Runs.Num());
+
+	uint8 Encoding = (uint8)(RunsSize < sizeof(Chunk.Bits) ? FVoxelChunkReader::EChunkEncoding::Runs : FVoxelChunkReader::EChunkEncoding::Bits);
+	Ar << Encoding;
+	if (Encoding == (uint8)FVoxelChunkReader::EChunkEncoding::Runs)
+	{
+		uint32 NumRuns = Runs.Num();
+		Ar.SerializeIntPacked(NumRuns);
+		for (uint32& Run : Runs)
+		{
+			Ar.SerializeIntPacked(Run);
+		}
+	}
+	else
+	{
+		for (uint64 Word : Chunk.Bits)
+		{
+			Ar << Word;
+		}
+	}
+}
+
+bool FVoxelChunkStore::Load(FArchive& Ar)
+{
+	check(Ar.IsLoading());
+	FVoxelChunkStore Loaded;
+	FVoxelChunkReader Reader(Ar);
+	Loaded.Chunks.Reserve(Reader.Num());
+	FIntVector Location;
+	FVoxelChunk Chunk;
+	while (Reader.ReadChunk(Location, Chunk))
+	{
+		Loaded.SetChunk(Location, Chunk);
+	}
+	if (Reader.IsError())
+	{
+		return false;
+	}
+	*this = MoveTemp(Loaded);
+	return true;
+}
+
+FVoxelChunkReader::FVoxelChunkReader(FArchive& InAr)
+	: Ar(InAr)
+{
+	check(Ar.IsLoading());
+	uint32 Count = 0;
+	Ar.SerializeIntPacked(Count);
+	//Every chunk takes at least 5 bytes, a bigger count can only come from corrupted data
+	const int64 TotalSize = Ar.TotalSize();
+	if (Ar.IsError() || (TotalSize >= 0 && Count > (TotalSize - Ar.Tell()) / 5))
+	{
+		bError = true;
+		return;
+	}
+	NumChunks = Count;
+}
+
+bool FVoxelChunkReader::ReadChunk(FIntVector& OutLocation, FVoxelChunk& OutChunk)
+{
+	if (IsError() || NumChunksRead >= NumChunks)
+	{
+		return false;
+	}
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		uint32 Coordinate = 0;
+		Ar.SerializeIntPacked(Coordinate);
+		PreviousLocation[Axis] += ZigZagDecode(Coordinate);
+	}
+	OutLocation = PreviousLocation;
+
+	if (!ReadChunkCubes(Ar, OutChunk))
+	{
+		bError = true;
+		return false;
+	}
+	NumChunksRead++;
+	return true;
+}
+
+bool FVoxelChunkReader::ReadChunkCubes(FArchive& Ar, FVoxelChunk& OutChunk)
+{
+	check(Ar.IsLoading());
+	OutChunk = FVoxelChunk();
+	uint8 Encoding = 0;
+	Ar << Encoding;
+	if (Encoding == (uint8)EChunkEncoding::Runs)
+	{
+		const uint32 ChunkVolume = FVoxelChunk::Size * FVoxelChunk::Size * FVoxelChunk::Size;
+		uint32 NumRuns = 0;
+		Ar.SerializeIntPacked(NumRuns);
+		if (NumRuns > ChunkVolume + 1)
+		{
+			return false;
+		}
+		uint32 Index = 0;
+		for (uint32 RunIdx = 0; RunIdx < NumRuns && !Ar.IsError(); RunIdx++)
+		{
+			uint32 RunLength = 0;
+			Ar.SerializeIntPacked(RunLength);
+			if (RunLength > ChunkVolume - Index)
+			{
+				return false;
+			}
+			if (RunIdx & 1)
+			{
+				OutChunk.FillRange(Index, RunLength);
+				OutChunk.NumCubes += RunLength;
+			}
+			Index += RunLength;
+		}
+	}
+	else if (Encoding == (uint8)EChunkEncoding::Bits)
+	{
+		for (uint64& Word : OutChunk.Bits)
+		{
+			Ar << Word;
+			OutChunk.NumCubes += FMath::CountBits(Word);
+		}
+	}
+	else
+	{
+		return false;
+	}
+	return !Ar.IsError();
+}
@@ -2,6 +2,30 @@
 
 #include "VoxelRMCProvider.h"
 #include "NoxelRenderer.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Voxel mesh triangles"), STAT_VoxelMeshTriangles, STATGROUP_NoxelRenderer);
+
+//Faces of a cube, the U and V texture coordinates growing along the same axes as the faces of the single cube mesh this replaced
+struct FVoxelFaceDirection
+{
+	FIntVector Normal;
+	int32 NormalAxis;
+	int32 NormalSign;
+	int32 UAxis;
+	int32 USign;
+	int32 VAxis;
+	int32 VSign;
+};
+
+static const FVoxelFaceDirection VoxelFaceDirections[6] =
+{
+	{ FIntVector(0, 0, 1), 2, 1, 1, -1, 0, 1 }, //Pos Z
+	{ FIntVector(-1, 0, 0), 0, -1, 1, -1, 2, 1 }, //Neg X
+	{ FIntVector(0, 1, 0), 1, 1, 0, -1, 2, 1 }, //Pos Y
+	{ FIntVector(1, 0, 0), 0, 1, 1, 1, 2, 1 }, //Pos X
+	{ FIntVector(0, -1, 0), 1, -1, 0, 1, 2, 1 }, //Neg Y
+	{ FIntVector(0, 0, -1), 2, -1, 1, 1, 0, 1 } //Neg Z
+};
 UVoxelRMCProvider::UVoxelRMCProvider()
 {
 	CubeRadius = 10.0f;
@@ -10,17 +34,88 @@ UVoxelRMCProvider::UVoxelRMCProvider()
 TArray<FIntVector> UVoxelRMCProvider::GetCubes() const
 {
 	FScopeLock Lock(&PropertySyncRoot);
-	return Cubes;
+	TArray<FIntVector> OutCubes;
+	Voxels.ToArray(OutCubes);
+	return OutCubes;
 }
 
-void UVoxelRMCProvider::SetCubes(const TArray<FIntVector> InCubes)
+void UVoxelRMCProvider::SetCubes(TArrayView<const FIntVector> InCubes)
 {
-	FScopeLock Lock(&PropertySyncRoot);
-	Cubes = InCubes;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		Voxels.Empty();
+		for (const FIntVector& Cube : InCubes)
+		{
+			Voxels.Add(Cube);
+		}
+		MarkAllChunksDirty();
+	}
+	CreateMissingSections();
+	MarkAllLODsDirty();
+	MarkCollisionDirty();
+}
+
+void UVoxelRMCProvider::SetVoxels(const FVoxelChunkStore& InVoxels)
+{
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		Voxels = InVoxels;
+		MarkAllChunksDirty();
+	}
+	CreateMissingSections();
 	MarkAllLODsDirty();
 	MarkCollisionDirty();
 }
 
+void UVoxelRMCProvider::SetChunk(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk)
+{
+	TSet<int32> DirtySections;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		Voxels.SetChunk(ChunkLocation, Chunk);
+		MarkChunkDirty(ChunkLocation, DirtySections);
+		//Any cube on the chunk's sides may have changed
+		for (const FVoxelFaceDirection& Direction : VoxelFaceDirections)
+		{
+			if (const int32* NeighbourSectionId = ChunkSections.Find(ChunkLocation + Direction.Normal))
+			{
+				DirtySections.Add(*NeighbourSectionId);
+			}
+		}
+	}
+	UpdateDirtySections(DirtySections);
+}
+
+bool UVoxelRMCProvider::AddCube(const FIntVector& Cube)
+{
+	TSet<int32> DirtySections;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		if (!Voxels.Add(Cube))
+		{
+			return false;
+		}
+		MarkCubeChunksDirty(Cube, DirtySections);
+	}
+	UpdateDirtySections(DirtySections);
+	return true;
+}
+
+bool UVoxelRMCProvider::RemoveCube(const FIntVector& Cube)
+{
+	TSet<int32> DirtySections;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		if (!Voxels.Remove(Cube))
+		{
+			return false;
+		}
+		MarkCubeChunksDirty(Cube, DirtySections);
+	}
+	UpdateDirtySections(DirtySections);
+	return true;
+}
+
 float UVoxelRMCProvider::GetCubeRadius() const
 {
 	FScopeLock Lock(&PropertySyncRoot);
@@ -29,10 +124,13 @@ float UVoxelRMCProvider::GetCubeRadius() const
 
 void UVoxelRMCProvider::SetCubeRadius(const float& InRadius)
 {
-	FScopeLock Lock(&PropertySyncRoot);
-	CubeRadius = InRadius;
-
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		CubeRadius = InRadius;
+		MarkAllChunksDirty();
+	}
 	MarkAllLODsDirty();
+	MarkCollisionDirty();
 }
 
 UMaterialInterface* UVoxelRMCProvider::GetVoxelMaterial() const
@@ -48,14 +146,165 @@ void UVoxelRMCProvider::SetVoxelMaterial(UMaterialInterface* InMaterial)
 	SetupMaterialSlot(0, FName("Voxel"), Material);
 }
 
-void UVoxelRMCProvider::GetMeshData(TArray<FIntVector>& OutCubes, float & OutRadius)
+bool UVoxelRMCProvider::GetSectionMeshData(int32 SectionId, FVoxelChunkStore& OutVoxels, FIntVector& OutChunk, float& OutRadius)
 {
 	FScopeLock Lock(&PropertySyncRoot);
-	OutCubes = Cubes;
+	if (!SectionChunks.IsValidIndex(SectionId))
+	{
+		return false;
+	}
+	OutChunk = SectionChunks[SectionId];
+	//A freed section only gets emptied
+	const int32* ChunkSectionId = ChunkSections.Find(OutChunk);
+	if (!ChunkSectionId || *ChunkSectionId != SectionId)
+	{
+		return false;
+	}
+	const FVoxelChunk* Chunk = Voxels.FindChunk(OutChunk);
+	if (!Chunk)
+	{
+		return false;
+	}
+	OutVoxels.SetChunk(OutChunk, *Chunk);
+	//Only the cubes next to the chunk's sides are read, to cull the faces between chunks
+	for (const FVoxelFaceDirection& Direction : VoxelFaceDirections)
+	{
+		if (const FVoxelChunk* NeighbourChunk = Voxels.FindChunk(OutChunk + Direction.Normal))
+		{
+			OutVoxels.SetChunk(OutChunk + Direction.Normal, *NeighbourChunk);
+		}
+	}
 	OutRadius = CubeRadius;
+	return true;
+}
+
+int32 UVoxelRMCProvider::GetChunkSection(const FIntVector& Chunk)
+{
+	if (const int32* SectionId = ChunkSections.Find(Chunk))
+	{
+		return *SectionId;
+	}
+	int32 SectionId;
+	if (FreeSections.Num() > 0)
+	{
+		SectionId = FreeSections.Pop(false);
+		SectionChunks[SectionId] = Chunk;
+	}
+	else
+	{
+		SectionId = SectionChunks.Add(Chunk);
+	}
+	ChunkSections.Add(Chunk, SectionId);
+	return SectionId;
 }
 
+void UVoxelRMCProvider::FreeChunkSection(const FIntVector& Chunk)
+{
+	int32 SectionId;
+	if (ChunkSections.RemoveAndCopyValue(Chunk, SectionId))
+	{
+		FreeSections.Add(SectionId);
+	}
+}
 
+void UVoxelRMCProvider::MarkChunkDirty(const FIntVector& Chunk, TSet<int32>& OutDirtySections)
+{
+	if (Voxels.FindChunk(Chunk))
+	{
+		OutDirtySections.Add(GetChunkSection(Chunk));
+	}
+	else if (const int32* SectionId = ChunkSections.Find(Chunk))
+	{
+		//Its last cube was removed, the section is still marked dirty so that it gets emptied
+		OutDirtySections.Add(*SectionId);
+		FreeChunkSection(Chunk);
+	}
+	DirtyCollisionChunks.Add(Chunk);
+}
+
+void UVoxelRMCProvider::MarkCubeChunksDirty(const FIntVector& Cube, TSet<int32>& OutDirtySections)
+{
+	const FIntVector Chunk = FVoxelChunkStore::CubeToChunk(Cube);
+	MarkChunkDirty(Chunk, OutDirtySections);
+	//A cube on the side of its chunk covers or uncovers a face of the neighbouring chunk
+	const FIntVector Local = Cube - Chunk * FVoxelChunk::Size;
+	for (const FVoxelFaceDirection& Direction : VoxelFaceDirections)
+	{
+		const int32 LocalCoordinate = Local[Direction.NormalAxis];
+		if (LocalCoordinate == (Direction.NormalSign > 0 ? FVoxelChunk::Size - 1 : 0))
+		{
+			if (const int32* NeighbourSectionId = ChunkSections.Find(Chunk + Direction.Normal))
+			{
+				OutDirtySections.Add(*NeighbourSectionId);
+			}
+		}
+	}
+}
+
+void UVoxelRMCProvider::MarkAllChunksDirty()
+{
+	//Every section gets remeshed, the ones of the chunks that were emptied are freed
+	TArray<FIntVector> EmptiedChunks;
+	for (const TPair<FIntVector, int32>& ChunkSection : ChunkSections)
+	{
+		if (!Voxels.FindChunk(ChunkSection.Key))
+		{
+			EmptiedChunks.Add(ChunkSection.Key);
+		}
+	}
+	for (const FIntVector& Chunk : EmptiedChunks)
+	{
+		FreeChunkSection(Chunk);
+	}
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : Voxels.GetChunks())
+	{
+		GetChunkSection(Chunk.Key);
+		DirtyCollisionChunks.Add(Chunk.Key);
+	}
+	//Chunks that were emptied have to lose their boxes
+	for (const TPair<FIntVector, TArray<FRuntimeMeshCollisionBox>>& Chunk : ChunkCollisionBoxes)
+	{
+		DirtyCollisionChunks.Add(Chunk.Key);
+	}
+}
+
+bool UVoxelRMCProvider::CreateMissingSections()
+{
+	int32 FirstSectionId, NumSections;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		if (NumCreatedSections == INDEX_NONE)
+		{
+			//Not initialized yet, Initialize will create them
+			return false;
+		}
+		FirstSectionId = NumCreatedSections;
+		NumSections = SectionChunks.Num();
+		NumCreatedSections = NumSections;
+	}
+	for (int32 SectionId = FirstSectionId; SectionId < NumSections; SectionId++)
+	{
+		FRuntimeMeshSectionProperties Properties;
+		Properties.bCastsShadow = true;
+		Properties.bIsVisible = true;
+		Properties.MaterialSlot = 0;
+		Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
+		CreateSection(0, SectionId, Properties);
+	}
+	return true;
+}
+
+void UVoxelRMCProvider::UpdateDirtySections(const TSet<int32>& DirtySections)
+{
+	if (CreateMissingSections())
+	{
+		for (int32 SectionId : DirtySections)
+		{
+			MarkSectionDirty(0, SectionId);
+		}
+	}
+	MarkCollisionDirty();
+}
 
 void UVoxelRMCProvider::Initialize()
 {
@@ -66,175 +315,300 @@ void UVoxelRMCProvider::Initialize()
 
 	SetupMaterialSlot(0, FName("Voxel"), GetVoxelMaterial());
 
-	FRuntimeMeshSectionProperties Properties;
-	Properties.bCastsShadow = true;
-	Properties.bIsVisible = true;
-	Properties.MaterialSlot = 0;
-	Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
-	CreateSection(0, 0, Properties);
-
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		NumCreatedSections = 0;
+	}
+	CreateMissingSections();
 	MarkAllLODsDirty();
+	MarkCollisionDirty();
 
 	//UE_LOG(NoxelRendererLog, Log, TEXT("[UVoxelRMCProvider::Initialize] Called"));
 }
 
 FBoxSphereBounds UVoxelRMCProvider::GetBounds()
 {
-	FBox BoundsVoxel = FBox(TArray<FVector>(Cubes));
+	FScopeLock Lock(&PropertySyncRoot);
+	FBox BoundsVoxel = Voxels.GetChunksBounds();
+	if (!BoundsVoxel.IsValid)
+	{
+		BoundsVoxel = FBox(FVector::ZeroVector, FVector::ZeroVector);
+	}
 	return FBoxSphereBounds(FBox(BoundsVoxel.Min * 2 * CubeRadius - FVector::OneVector * CubeRadius, BoundsVoxel.Max * 2 * CubeRadius + FVector::OneVector * CubeRadius));
 }
 
 bool UVoxelRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData)
-{	// We should only ever be queried for section 0 and lod 0
-	check(SectionId == 0 && LODIndex == 0);
-
-
+{	// We should only ever be queried for lod 0, each section is a chunk
+	check(LODIndex == 0);
 
 	//UE_LOG(NoxelRendererLog, Log, TEXT("[UVoxelRMCProvider::GetSectionMeshForLOD] Called"));
 
-	TArray<FIntVector> TempCubes;
+	FVoxelChunkStore TempVoxels;
+	FIntVector TempChunk;
 	float TempRadius;
-	GetMeshData(TempCubes, TempRadius);
-
-	if (TempCubes.Num() == 0)
+	if (!GetSectionMeshData(SectionId, TempVoxels, TempChunk, TempRadius))
 	{
 		return false;
 	}
 	
-	//UE_LOG(NoxelRendererLog, Log, TEXT("[UVoxelRMCProvider::GetSectionMeshForLOD] %i cubes, %f radius"), TempCubes.Num(), TempRadius);
+	//UE_LOG(NoxelRendererLog, Log, TEXT("[UVoxelRMCProvider::GetSectionMeshForLOD] %i cubes, %f radius"), TempVoxels.Num(), TempRadius);
 
-	// Generate verts
-	FVector BoxVerts[8];
-	BoxVerts[0] = FVector(-TempRadius, TempRadius, TempRadius);
-	BoxVerts[1] = FVector(TempRadius, TempRadius, TempRadius);
-	BoxVerts[2] = FVector(TempRadius, -TempRadius, TempRadius);
-	BoxVerts[3] = FVector(-TempRadius, -TempRadius, TempRadius);
-
-	BoxVerts[4] = FVector(-TempRadius, TempRadius, -TempRadius);
-	BoxVerts[5] = FVector(TempRadius, TempRadius, -TempRadius);
-	BoxVerts[6] = FVector(TempRadius, -TempRadius, -TempRadius);
-	BoxVerts[7] = FVector(-TempRadius, -TempRadius, -TempRadius);
+	BuildChunkMesh(TempVoxels, TempChunk, TempRadius, MeshData);
+	return MeshData.Triangles.Num() > 0;
+}
 
-	for (int32 CubeIdx = 0; CubeIdx < TempCubes.Num(); CubeIdx++)
+void UVoxelRMCProvider::BuildVoxelMesh(const FVoxelChunkStore& TempVoxels, float TempRadius, FRuntimeMeshRenderableMeshData& MeshData, bool bGreedy)
+{
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : TempVoxels.GetChunks())
 	{
-		//UE_LOG(NoxelRendererLog, Log, TEXT("[UVoxelRMCProvider::GetSectionMeshForLOD] Cube Index %i"), CubeIdx);
-		FIntVector Cube = TempCubes[CubeIdx];
+		BuildChunkMesh(TempVoxels, Chunk.Key, TempRadius, MeshData, bGreedy);
+	}
+}
 
-		auto AddVertex = [&](const FVector& InPosition, const FVector& InTangentX, const FVector& InTangentZ, const FVector2D& InTexCoord)
-		{
-			MeshData.Positions.Add(InPosition + FVector(Cube) * TempRadius * 2);
-			MeshData.Tangents.Add(InTangentZ, InTangentX);
-			MeshData.Colors.Add(FColor::White);
-			MeshData.TexCoords.Add(InTexCoord);
-		};
+void UVoxelRMCProvider::BuildChunkMesh(const FVoxelChunkStore& TempVoxels, const FIntVector& ChunkLocation, float TempRadius, FRuntimeMeshRenderableMeshData& MeshData, bool bGreedy)
+{
+	const FVoxelChunk* Chunk = TempVoxels.FindChunk(ChunkLocation);
+	if (!Chunk)
+	{
+		return;
+	}
+	const int32 Size = FVoxelChunk::Size;
+	const FIntVector ChunkBase = ChunkLocation * Size;
+	const int32 Base[3] = { ChunkBase.X, ChunkBase.Y, ChunkBase.Z };
+	const int32 NumTrianglesBefore = MeshData.Triangles.Num() / 3;
 
-		auto AddTriangle = [&](const int32 A, const int32 B, const int32 C)
+	for (const FVoxelFaceDirection& Direction : VoxelFaceDirections)
+	{
+		//Cubes past the chunk's side are looked up in the neighbouring chunk
+		const FVoxelChunk* NeighbourChunk = TempVoxels.FindChunk(ChunkLocation + Direction.Normal);
+		const int32 NormalStep = Direction.NormalSign;
+		const FVector TangentZ = FVector(Direction.Normal);
+		FVector TangentX = FVector::ZeroVector;
+		TangentX[Direction.UAxis] = Direction.USign;
+
+		//Emits the face of W by H cubes starting at (I0, J0) along the U and V axes, on the side of the slice facing the normal
+		auto AddQuad = [&](int32 Slice, int32 I0, int32 J0, int32 W, int32 H)
 		{
-			int32 NumVerts = MeshData.Positions.Num();
-			MeshData.Triangles.AddTriangle(A + NumVerts, B + NumVerts, C + NumVerts);
+			float Low[3], High[3];
+			Low[Direction.UAxis] = (Base[Direction.UAxis] + I0) * TempRadius * 2 - TempRadius;
+			High[Direction.UAxis] = (Base[Direction.UAxis] + I0 + W - 1) * TempRadius * 2 + TempRadius;
+			Low[Direction.VAxis] = (Base[Direction.VAxis] + J0) * TempRadius * 2 - TempRadius;
+			High[Direction.VAxis] = (Base[Direction.VAxis] + J0 + H - 1) * TempRadius * 2 + TempRadius;
+			Low[Direction.NormalAxis] = High[Direction.NormalAxis] = (Base[Direction.NormalAxis] + Slice) * TempRadius * 2 + NormalStep * TempRadius;
+
+			//Corner where both texture coordinates are 0, then corners at the end of V, of both, and of U
+			auto Corner = [&](bool bEndU, bool bEndV)
+			{
+				FVector Position;
+				Position[Direction.NormalAxis] = Low[Direction.NormalAxis];
+				Position[Direction.UAxis] = (bEndU == (Direction.USign > 0)) ? High[Direction.UAxis] : Low[Direction.UAxis];
+				Position[Direction.VAxis] = (bEndV == (Direction.VSign > 0)) ? High[Direction.VAxis] : Low[Direction.VAxis];
+				return Position;
+			};
+			const int32 FirstVertex = MeshData.Positions.Num();
+			//Texture coordinates are tiled once per cube, like the faces of single cubes
+			MeshData.Positions.Add(Corner(false, false));
+			MeshData.TexCoords.Add(FVector2D(0.f, 0.f));
+			MeshData.Positions.Add(Corner(false, true));
+			MeshData.TexCoords.Add(FVector2D(0.f, H));
+			MeshData.Positions.Add(Corner(true, true));
+			MeshData.TexCoords.Add(FVector2D(W, H));
+			MeshData.Positions.Add(Corner(true, false));
+			MeshData.TexCoords.Add(FVector2D(W, 0.f));
+			for (int32 VertexIdx = 0; VertexIdx < 4; VertexIdx++)
+			{
+				MeshData.Tangents.Add(TangentZ, TangentX);
+				MeshData.Colors.Add(FColor::White);
+			}
+			MeshData.Triangles.AddTriangle(FirstVertex, FirstVertex + 1, FirstVertex + 3);
+			MeshData.Triangles.AddTriangle(FirstVertex + 1, FirstVertex + 2, FirstVertex + 3);
 		};
 
-		FVector TangentX, TangentY, TangentZ;
-
-		if (!TempCubes.Contains(Cube + FIntVector(0, 0, 1)))
+		bool Mask[FVoxelChunk::Size * FVoxelChunk::Size];
+		for (int32 Slice = 0; Slice < Size; Slice++)
 		{
-			// Pos Z
-			TangentZ = FVector(0.0f, 0.0f, 1.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
-		}
-
-		if (!TempCubes.Contains(Cube + FIntVector(-1, 0, 0)))
-		{
-			// Neg X
-			TangentZ = FVector(-1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
-		}
-
-		if (!TempCubes.Contains(Cube + FIntVector(0, 1, 0)))
-		{
-			// Pos Y
-			TangentZ = FVector(0.0f, 1.0f, 0.0f);
-			TangentX = FVector(-1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
-		}
-
-		if (!TempCubes.Contains(Cube + FIntVector(1, 0, 0)))
-		{
-			// Pos X
-			TangentZ = FVector(1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
+			//Faces of the slice that aren't covered by a cube, indexed by I + J * Size
+			bool bAnyFace = false;
+			for (int32 J = 0; J < Size; J++)
+			{
+				for (int32 I = 0; I < Size; I++)
+				{
+					int32 Local[3];
+					Local[Direction.NormalAxis] = Slice;
+					Local[Direction.UAxis] = I;
+					Local[Direction.VAxis] = J;
+					bool bFace = Chunk->Get(Local[0], Local[1], Local[2]);
+					if (bFace)
+					{
+						Local[Direction.NormalAxis] += NormalStep;
+						if (Local[Direction.NormalAxis] >= 0 && Local[Direction.NormalAxis] < Size)
+						{
+							bFace = !Chunk->Get(Local[0], Local[1], Local[2]);
+						}
+						else
+						{
+							Local[Direction.NormalAxis] = (Local[Direction.NormalAxis] + Size) % Size;
+							bFace = !NeighbourChunk || !NeighbourChunk->Get(Local[0], Local[1], Local[2]);
+						}
+					}
+					Mask[I + J * Size] = bFace;
+					bAnyFace |= bFace;
+				}
+			}
+			if (!bAnyFace)
+			{
+				continue;
+			}
+
+			//Grow each face along U then along V into the largest rectangle of uncovered faces
+			for (int32 J = 0; J < Size; J++)
+			{
+				for (int32 I = 0; I < Size; I++)
+				{
+					if (!Mask[I + J * Size])
+					{
+						continue;
+					}
+					int32 W = 1, H = 1;
+					if (bGreedy)
+					{
+						while (I + W < Size && Mask[I + W + J * Size])
+						{
+							W++;
+						}
+						for (; J + H < Size; H++)
+						{
+							bool bRowFilled = true;
+							for (int32 RowI = I; RowI < I + W && bRowFilled; RowI++)
+							{
+								bRowFilled = Mask[RowI + (J + H) * Size];
+							}
+							if (!bRowFilled)
+							{
+								break;
+							}
+						}
+					}
+					for (int32 RectJ = J; RectJ < J + H; RectJ++)
+					{
+						for (int32 RectI = I; RectI < I + W; RectI++)
+						{
+							Mask[RectI + RectJ * Size] = false;
+						}
+					}
+					AddQuad(Slice, I, J, W, H);
+				}
+			}
 		}
+	}
+	INC_DWORD_STAT_BY(STAT_VoxelMeshTriangles, MeshData.Triangles.Num() / 3 - NumTrianglesBefore);
+}
 
-		if (!TempCubes.Contains(Cube + FIntVector(0, -1, 0)))
-		{
-			// Neg Y
-			TangentZ = FVector(0.0f, -1.0f, 0.0f);
-			TangentX = FVector(1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
-		}
+void UVoxelRMCProvider::BuildVoxelCollisionBoxes(const FVoxelChunkStore& TempVoxels, float TempRadius, TArray<FRuntimeMeshCollisionBox>& OutBoxes)
+{
+	for (const TPair<FIntVector, FVoxelChunk>& Chunk : TempVoxels.GetChunks())
+	{
+		BuildChunkCollisionBoxes(Chunk.Key, Chunk.Value, TempRadius, OutBoxes);
+	}
+}
 
-		if (!TempCubes.Contains(Cube + FIntVector(0, 0, -1)))
+void UVoxelRMCProvider::BuildChunkCollisionBoxes(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk, float Radius, TArray<FRuntimeMeshCollisionBox>& OutBoxes)
+{
+	const int32 Size = FVoxelChunk::Size;
+	//Cubes of the chunk that aren't in a box yet
+	FVoxelChunk Remaining = Chunk;
+	auto IsRemaining = [&](int32 X, int32 Y, int32 Z)
+	{
+		return Remaining.Get(X, Y, Z);
+	};
+	for (int32 Z = 0; Z < Size; Z++)
+	{
+		for (int32 Y = 0; Y < Size; Y++)
 		{
-			// Neg Z
-			TangentZ = FVector(0.0f, 0.0f, -1.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			AddTriangle(-4, -3, -1);
-			AddTriangle(-3, -2, -1);
+			for (int32 X = 0; X < Size; X++)
+			{
+				if (!IsRemaining(X, Y, Z))
+				{
+					continue;
+				}
+				//Grow along X, then Y while the whole row is filled, then Z while the whole layer is
+				int32 SizeX = 1, SizeY = 1, SizeZ = 1;
+				while (X + SizeX < Size && IsRemaining(X + SizeX, Y, Z))
+				{
+					SizeX++;
+				}
+				auto IsRowFilled = [&](int32 RowY, int32 RowZ)
+				{
+					for (int32 RowX = X; RowX < X + SizeX; RowX++)
+					{
+						if (!IsRemaining(RowX, RowY, RowZ))
+						{
+							return false;
+						}
+					}
+					return true;
+				};
+				while (Y + SizeY < Size && IsRowFilled(Y + SizeY, Z))
+				{
+					SizeY++;
+				}
+				for (; Z + SizeZ < Size; SizeZ++)
+				{
+					bool bLayerFilled = true;
+					for (int32 LayerY = Y; LayerY < Y + SizeY && bLayerFilled; LayerY++)
+					{
+						bLayerFilled = IsRowFilled(LayerY, Z + SizeZ);
+					}
+					if (!bLayerFilled)
+					{
+						break;
+					}
+				}
+				for (int32 BoxZ = Z; BoxZ < Z + SizeZ; BoxZ++)
+				{
+					for (int32 BoxY = Y; BoxY < Y + SizeY; BoxY++)
+					{
+						for (int32 BoxX = X; BoxX < X + SizeX; BoxX++)
+						{
+							const int32 Index = FVoxelChunk::LocalIndex(BoxX, BoxY, BoxZ);
+							Remaining.Bits[Index >> 6] &= ~(1ull << (Index & 63));
+						}
+					}
+				}
+				const FVector FirstCube = FVector(ChunkLocation * Size + FIntVector(X, Y, Z));
+				const FVector BoxSize(SizeX, SizeY, SizeZ);
+				FRuntimeMeshCollisionBox Box;
+				Box.Extents = BoxSize * Radius * 2;
+				Box.Center = (FirstCube + (BoxSize - FVector::OneVector) / 2) * Radius * 2;
+				Box.Rotation = FRotator::ZeroRotator;
+				OutBoxes.Add(Box);
+			}
 		}
 	}
-	
-
-	return true;
 }
 
 FRuntimeMeshCollisionSettings UVoxelRMCProvider::GetCollisionSettings()
 {
+	FScopeLock Lock(&PropertySyncRoot);
 	FRuntimeMeshCollisionSettings Settings;
-	Settings.bUseAsyncCooking = false;
+	Settings.bUseAsyncCooking = true;
 	Settings.bUseComplexAsSimple = false;
-	Settings.Boxes.Reserve(Cubes.Num());
-
-	for (int32 CubeIdx = 0; CubeIdx < Cubes.Num(); CubeIdx++)
+	for (const FIntVector& Chunk : DirtyCollisionChunks)
+	{
+		const FVoxelChunk* ChunkData = Voxels.FindChunk(Chunk);
+		if (!ChunkData)
+		{
+			ChunkCollisionBoxes.Remove(Chunk);
+			continue;
+		}
+		TArray<FRuntimeMeshCollisionBox>& Boxes = ChunkCollisionBoxes.FindOrAdd(Chunk);
+		Boxes.Reset();
+		BuildChunkCollisionBoxes(Chunk, *ChunkData, CubeRadius, Boxes);
+	}
+	DirtyCollisionChunks.Reset();
+	for (const TPair<FIntVector, TArray<FRuntimeMeshCollisionBox>>& Chunk : ChunkCollisionBoxes)
 	{
-		FIntVector Cube = Cubes[CubeIdx];
-		FVector Cubelocation = FVector(Cube) * 2 * CubeRadius;
-		FRuntimeMeshCollisionBox Box;
-		Box.Extents = FVector(CubeRadius*2);
-		Box.Center = Cubelocation;
-		Box.Rotation = FRotator::ZeroRotator;
-		Settings.Boxes.Add(Box);
+		Settings.Boxes.Append(Chunk.Value);
 	}
 
 	return Settings;
@@ -247,10 +621,7 @@ bool UVoxelRMCProvider::HasCollisionMesh()
 
 bool UVoxelRMCProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData)
 {
-	if (Cubes.Num() == 0)
-	{
-		return false;
-	}
+	//The collision is only made of boxes
 	return false;
 }
 
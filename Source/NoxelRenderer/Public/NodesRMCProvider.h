@@ -27,17 +27,23 @@ private:
 
 	//Baked renderable data from the static mesh
 	FRuntimeMeshRenderableMeshData StaticMeshRenderable;
-	//Baked collidable data from the static mesh
-	FRuntimeMeshCollisionData StaticMeshCollidable;
-	//Baked collision settings data from the static mesh
-	FRuntimeMeshCollisionSettings StaticMeshSettings;
 
 	//Array of nodes to be rendered
 	TArray<FNoxelRendererNodeData> Nodes;
+	//Incremented on every change of the nodes or of the node mesh
+	uint32 NodesVersion = 0;
+
+	//Render mesh of all the nodes, kept so that color changes only rewrite the vertices of the changed nodes
+	FRuntimeMeshRenderableMeshData CachedMesh;
+	bool bIsCachedMeshDirty = true;
 
 	//Material used to render the nodes
 	UMaterialInterface* NodesMaterial;
 
+	//Only the collision is built, the renderable data of the static mesh isn't even copied
+	//Also used when the nodes are rendered by instances instead
+	bool bCollisionOnly = false;
+
 public:
 	UNodesRMCProvider();
 
@@ -49,11 +55,23 @@ public:
 
 	TArray<FNoxelRendererNodeData> GetNodes() const;
 	void SetNodes(const TArray<FNoxelRendererNodeData>& InNodes);
+	//Only rewrites the vertex colors of the given nodes, by index, the collision isn't rebuilt
+	//The mesh isn't rebuilt either, but the whole section is still copied and uploaded again
+	//Use the instanced nodes to only send the colors that changed
+	void SetNodesColor(const TArray<TPair<int32, FColor>>& InColors);
 
 	UMaterialInterface* GetNodesMaterial() const;
 	void SetNodesMaterial(UMaterialInterface* InNodesMaterial);
 
-	bool GetHitNodeIndex(int32 faceIndex, int32& HitNode) const;
+	bool IsCollisionOnly() const;
+	//Has to be set before the static mesh and before the provider is initialized
+	void SetCollisionOnly(bool bInCollisionOnly);
+
+	//Finds the first node whose bounding sphere is crossed by the segment, in component space
+	bool GetNodeOnRay(const FVector& RayStart, const FVector& RayEnd, int32& HitNode) const;
+
+	//Copies NodeMesh at the location of every node, with the node's color
+	static void BuildNodesMesh(const FRuntimeMeshRenderableMeshData& NodeMesh, const TArray<FNoxelRendererNodeData>& InNodes, FRuntimeMeshRenderableMeshData& MeshData);
 	
 protected:
 	void Initialize() override;
@@ -67,7 +85,5 @@ protected:
 private:
 	void PrepareStaticMesh();
 
-	void GetShapeMeshParams(FRuntimeMeshRenderableMeshData& OutStaticMeshRenderable, TArray<FNoxelRendererNodeData>& OutNodes);
-
-	void GetShapeCollisionParams(FRuntimeMeshCollisionData& OutStaticMeshCollidable, TArray<FNoxelRendererNodeData>& OutNodes);
+	void GetShapeMeshParams(FRuntimeMeshRenderableMeshData& OutStaticMeshRenderable, TArray<FNoxelRendererNodeData>& OutNodes, uint32& OutNodesVersion);
 };
@@ -7,28 +7,50 @@
 #include "NoxelRendererStructs.h"
 #include "NoxelRMCProvider.generated.h"
 
+struct FNoxelIntersectionScratch;
+
 UCLASS(HideCategories = Object, BlueprintType)
 class NOXELRENDERER_API UNoxelRMCProvider : public URuntimeMeshProvider
 {
 	GENERATED_BODY()
 private:
 	mutable FCriticalSection PropertySyncRoot;
-	TArray<FVector> Nodes;
 
-	TArray<FNoxelRendererPanelData> Panels;
+	//Current nodes and panels, edited in place unless a reader holds a reference to them, in which case a new version is made
+	TSharedRef<FNoxelRendererShape, ESPMode::ThreadSafe> Shape = MakeShared<FNoxelRendererShape, ESPMode::ThreadSafe>();
 
 	UMaterialInterface* NoxelMaterial;
 
+	FNoxelCollisionSimplificationSettings CollisionSimplification;
+
+	//Only the collision is built : no render LOD, section or intersection cache
+	bool bCollisionOnly = false;
+
 	mutable FRWLock CacheSyncRoot;
-	//Should cache be rebuilt ?
+	//Held while the cache is being rebuilt
+	FCriticalSection CacheBuildSyncRoot;
+	//Should the whole cache be rebuilt ?
 	bool bIsCacheDirty;
+	//Index of the panels whose intersections should be rebuilt
+	TSet<int32> DirtyCachedPanels;
 	//Cached intersection data, needed for LODs 0 and 1
 	TArray<FNoxelRendererBakedIntersectionData> CachedIntersectionData;
 
-	//Links the face index to the PanelIndex
-	TArray<int32> CollisionMap;
+	//Panels are bucketed in spatial chunks, each rendered by its own section so that an edit only remeshes the chunks it touches
+	//SectionId of each chunk, sections are never removed and get reused if panels come back
+	TMap<FIntVector, int32> ChunkSections;
+	//Index in Panels of the panels rendered by each section
+	TArray<TArray<int32>> SectionPanels;
+	//SectionId of each panel
+	TArray<int32> PanelSections;
+	//Number of sections created on the mesh, INDEX_NONE until initialized
+	int32 NumCreatedSections = INDEX_NONE;
+
+	//First collision triangle of each panel and its PanelIndex, sorted by triangle
+	//Ends with the number of triangles and INDEX_NONE
+	TArray<TPair<int32, int32>> CollisionMap;
 	//CollisionMap waiting for collision cooking to finish
-	TArray<int32> NewCollisionMap;
+	TArray<TPair<int32, int32>> NewCollisionMap;
 
 public:
 	UFUNCTION(BlueprintPure)
@@ -41,11 +63,45 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetPanels(UPARAM(ref) const TArray<FNoxelRendererPanelData>& InPanels);
 
+	//The node and adjacency arrays of FNoxelRendererPanelData use inline allocators and can't be reflected, these expose them to blueprints
+	UFUNCTION(BlueprintPure)
+	static TArray<int32> GetPanelNodes(const FNoxelRendererPanelData& Panel);
+	UFUNCTION(BlueprintCallable)
+	static void SetPanelNodes(UPARAM(ref) FNoxelRendererPanelData& Panel, const TArray<int32>& InNodes);
+	UFUNCTION(BlueprintPure)
+	static TArray<int32> GetPanelAdjacentPanels(const FNoxelRendererPanelData& Panel);
+	UFUNCTION(BlueprintCallable)
+	static void SetPanelAdjacentPanels(UPARAM(ref) FNoxelRendererPanelData& Panel, const TArray<int32>& InAdjacentPanels);
+	UFUNCTION(BlueprintPure)
+	static void GetPanelSideAdjacency(const FNoxelRendererPanelData& Panel, TArray<int32>& OutSideAdjacentPanels, TArray<int32>& OutSideAdjacencyOffsets);
+	UFUNCTION(BlueprintCallable)
+	static void SetPanelSideAdjacency(UPARAM(ref) FNoxelRendererPanelData& Panel, const TArray<int32>& InSideAdjacentPanels, const TArray<int32>& InSideAdjacencyOffsets);
+
+	//CPU memory used by the panels of the current shape, in bytes
+	SIZE_T GetPanelsAllocatedSize() const;
+
+	//Applies the changes made to the nodes and panels since the last update
+	void ApplyDelta(const FNoxelRendererDelta& Delta);
+
+	//Current version of the nodes and panels, it won't change while the reference is held
+	FNoxelRendererShapeRef GetShape() const;
+
 	UFUNCTION(BlueprintPure)
 	UMaterialInterface* GetNoxelMaterial() const;
 	UFUNCTION(BlueprintCallable)
 	void SetNoxelMaterial(UMaterialInterface* InNoxelMaterial);
 
+	UFUNCTION(BlueprintPure)
+	FNoxelCollisionSimplificationSettings GetCollisionSimplification() const;
+	UFUNCTION(BlueprintCallable)
+	void SetCollisionSimplification(const FNoxelCollisionSimplificationSettings& InCollisionSimplification);
+
+	UFUNCTION(BlueprintPure)
+	bool IsCollisionOnly() const;
+	//Has to be set before the provider is initialized, used on dedicated servers where nothing is rendered
+	UFUNCTION(BlueprintCallable)
+	void SetCollisionOnly(bool bInCollisionOnly);
+
 	UFUNCTION(BlueprintPure)
 	bool GetPanelIndexHit(int32 HitTriangleIndex, int32& OutPanelIndex) const;
 
@@ -72,26 +128,54 @@ public:
 	UFUNCTION(BlueprintCallable)
 	static float ComputeTriangleFanArea(FVector Center, TArray<FVector> Nodes);
 
+	//Computes the intersections of the panels at PanelIndices, OutIntersectionData[i] matching PanelIndices[i]
+	//Panels are spread over the task graph workers unless bParallel is false
+	static void BakeIntersections(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels, const TArray<int32>& PanelIndices,
+		TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData, bool bParallel = true);
+
+	//Builds the render mesh of all the panels, AllPanelsIntersections is only read for LODs 0 and 1
+	//If bShareVertices, vertices of a panel with the same position, normal and UV are only added once
+	//If bAnalyticNormals, normals and tangents are written along with the vertices, otherwise they are computed from the triangles afterwards
+	static void BuildSectionMesh(int32 LODIndex, const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+		const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, FRuntimeMeshRenderableMeshData& MeshData,
+		bool bShareVertices = true, bool bAnalyticNormals = true);
+
+	//Builds the convex elements of the simple collision, adjacent panels lying in the same slab are merged into a single element
+	//The complex collision mesh, which GetPanelIndexHit resolves, keeps one set of triangles per panel
+	static void BuildCollisionConvexes(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+		const FNoxelCollisionSimplificationSettings& Simplification, TArray<FRuntimeMeshCollisionConvexMesh>& OutConvexElems);
+
+#if !UE_BUILD_SHIPPING
+	//Same mesh as BuildSectionMesh without shared vertices, but every vertex and triangle goes through a TFunction
+	//Only kept for the benchmark, to measure the cost of the indirection against the inlined writers
+	static void BuildSectionMeshWithCallbacks(int32 LODIndex, const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels,
+		const TArray<FNoxelRendererBakedIntersectionData>& AllPanelsIntersections, FRuntimeMeshRenderableMeshData& MeshData);
+#endif
+
 private:
-	void GetShapeParams(TArray<FVector>& OutNodes, TArray<FNoxelRendererPanelData>& OutPanels);
-	//Mark the cache as needing a rebuild
+	//Gives the shape for modification, copying it first if a reader still holds it, PropertySyncRoot must be held
+	FNoxelRendererShape& EditShape();
+	//Copies the panels of a section, OutPanelIndices being their index in the shape's panels, the nodes are shared
+	FNoxelRendererShapeRef GetSectionShapeParams(int32 SectionId, TArray<FNoxelRendererPanelData>& OutPanels, TArray<int32>& OutPanelIndices);
+
+	static FIntVector LocationToChunk(const FVector& Location);
+	//Puts the panel in the section of the chunk its center is in, PropertySyncRoot must be held
+	void AssignPanelSection(int32 PanelIdx, TSet<int32>& OutDirtySections);
+	//Takes the panel out of its section, PropertySyncRoot must be held
+	void RemovePanelSection(int32 PanelIdx, TSet<int32>& OutDirtySections);
+	//Creates the sections of the chunks that appeared since the last call, returns false if not initialized yet
+	bool CreateMissingSections();
+	//Mark the whole cache as needing a rebuild
 	void MarkCacheDirty();
-	//Returns !bIsCacheDirty
-	bool GetCachedData(TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData);
-	//Build the intersection cache, should be called before any mesh generation
+	//Mark the intersections of some panels as needing a rebuild
+	void MarkCachedPanelsDirty(const TSet<int32>& InPanels);
+	//Copies the intersections of the panels at PanelIndices, returns true if no panel is dirty
+	bool GetCachedData(const TArray<int32>& PanelIndices, TArray<FNoxelRendererBakedIntersectionData>& OutIntersectionData);
+	//Rebuild the dirty parts of the intersection cache, should be called before any mesh generation
 	void MakeCacheIfDirty();
-
-	//Used to reserve memory
-	//NumTriangle is the amount of triangles, not triangle indices
-	void GetNumIndicesPerSide(int32 LODIndex, int32& NumVertices, int32& NumTriangles);
-
-	int32 GetNumSides(TArray<FNoxelRendererPanelData>& InPanels);
-
-	//Makes the mesh for a single panel
-	//PanelNodes is an array where Panel.Nodes[i]'s location is stored in PanelNodes[i]
-	void MakeMeshForLOD(int32 LODIndex, int32 SectionId, TArray<FVector>& PanelNodes, FNoxelRendererPanelData& Panel, FNoxelRendererBakedIntersectionData& ThisPanelIntersectionData,
-		TFunction<void(const FVector& InPosition, const FVector2D& InTexCoord)> AddVertex,
-		TFunction<void(const int32 A, const int32 B, const int32 C)> AddTriangle);
+	//Computes the intersections of the sides of a panel with the sides of its neighbours
+	static void BakePanelIntersections(const TArray<FVector>& TempNodes, const TArray<FNoxelRendererPanelData>& TempPanels, int32 PanelIdx,
+		FNoxelRendererBakedIntersectionData& OutIntersectionData, FNoxelIntersectionScratch& Scratch);
 
 protected:
 	void Initialize() override;
@@ -1,6 +1,10 @@
 //Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
 
+#pragma once
+
 #include "CoreMinimal.h"
 #include "Engine.h"
 
-DECLARE_LOG_CATEGORY_EXTERN(NoxelRendererLog, Log, All);
\ No newline at end of file
+DECLARE_LOG_CATEGORY_EXTERN(NoxelRendererLog, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("NoxelRenderer"), STATGROUP_NoxelRenderer, STATCAT_Advanced);
@@ -65,6 +65,12 @@ struct FNoxelRendererBakedIntersectionData
 	{}
 };
 
+//Most panels have 3 to 6 nodes and as many neighbours, kept inline to avoid heap allocations per panel
+//UHT only reflects arrays using the default allocator, so fields of these types can't be UPROPERTYs, use the accessors on UNoxelRMCProvider from blueprints
+typedef TArray<int32, TInlineAllocator<6>> FNoxelRendererPanelIndexArray;
+//One offset per side plus the end offset
+typedef TArray<int32, TInlineAllocator<7>> FNoxelRendererSideOffsetArray;
+
 USTRUCT(BlueprintType)
 struct FNoxelRendererPanelData
 {
@@ -72,8 +78,7 @@ struct FNoxelRendererPanelData
 
 	UPROPERTY(BlueprintReadWrite)
 	int32 PanelIndex; //Used only for collision
-	UPROPERTY(BlueprintReadWrite)
-	TArray<int32> Nodes;
+	FNoxelRendererPanelIndexArray Nodes;
 	UPROPERTY(BlueprintReadWrite)
 	float ThicknessNormal;
 	UPROPERTY(BlueprintReadWrite)
@@ -84,8 +89,9 @@ struct FNoxelRendererPanelData
 	FVector Normal;
 	UPROPERTY(BlueprintReadWrite)
 	FVector Center;
-	UPROPERTY(BlueprintReadWrite)
-	TArray<int32> AdjacentPanels; //Contains the indices of the panels it's connected to in the Panels array
+	FNoxelRendererPanelIndexArray AdjacentPanels; //Contains the indices of the panels it's connected to in the Panels array
+	FNoxelRendererPanelIndexArray SideAdjacentPanels; //Indices in the Panels array of the panels sharing each side, grouped by side
+	FNoxelRendererSideOffsetArray SideAdjacencyOffsets; //Side i is shared with SideAdjacentPanels[SideAdjacencyOffsets[i]] to SideAdjacentPanels[SideAdjacencyOffsets[i+1]-1], empty if unknown
 
 	FNoxelRendererPanelData()
 		: PanelIndex(),
@@ -95,17 +101,77 @@ struct FNoxelRendererPanelData
 		Area(1.0f),
 		Normal(FVector::UpVector),
 		Center(FVector::ZeroVector),
-		AdjacentPanels()
+		AdjacentPanels(),
+		SideAdjacentPanels(),
+		SideAdjacencyOffsets()
 	{}
 
-	FNoxelRendererPanelData(const int32 InPanelIndex, const TArray<int32>& InNodes, const float InThicknessNormal, const float InThicknessAntiNormal, const float InArea, const FVector InNormal, const FVector InCenter, const TArray<int32>& InAdjacentPanels)
+	FNoxelRendererPanelData(const int32 InPanelIndex, TArrayView<const int32> InNodes, const float InThicknessNormal, const float InThicknessAntiNormal, const float InArea, const FVector InNormal, const FVector InCenter, TArrayView<const int32> InAdjacentPanels)
 		: PanelIndex(InPanelIndex),
-		Nodes(InNodes),
+		Nodes(InNodes.GetData(), InNodes.Num()),
 		ThicknessNormal(InThicknessNormal),
 		ThicknessAntiNormal(InThicknessAntiNormal),
 		Area(InArea),
 		Normal(InNormal),
 		Center(InCenter),
-		AdjacentPanels(InAdjacentPanels)
+		AdjacentPanels(InAdjacentPanels.GetData(), InAdjacentPanels.Num()),
+		SideAdjacentPanels(),
+		SideAdjacencyOffsets()
+	{}
+};
+
+//Nodes and panels of a noxel provider at one point in time, never modified once handed out to a reader
+//Mesh and collision builds keep a reference to the version they started with instead of copying the arrays
+struct FNoxelRendererShape
+{
+	TArray<FVector> Nodes;
+	TArray<FNoxelRendererPanelData> Panels;
+};
+
+typedef TSharedRef<const FNoxelRendererShape, ESPMode::ThreadSafe> FNoxelRendererShapeRef;
+
+//Controls how adjacent panels are merged into a single convex element of the simple collision
+USTRUCT(BlueprintType)
+struct FNoxelCollisionSimplificationSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool bMergePanels;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float MaxAngle; //Maximum angle between the normals of merged panels, in degrees
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float MaxDistance; //Maximum distance of a merged panel's center to the element's plane, and maximum difference of thickness
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float MaxAreaError; //Maximum part of the element's area that isn't covered by its panels
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int32 MaxPanelsPerElement;
+
+	FNoxelCollisionSimplificationSettings()
+		: bMergePanels(true),
+		MaxAngle(1.0f),
+		MaxDistance(0.5f),
+		MaxAreaError(0.02f),
+		MaxPanelsPerElement(64)
+	{}
+};
+
+//Incremental update of the data of a noxel provider, indices are indices in the provider's arrays
+struct FNoxelRendererDelta
+{
+	//Number of nodes after the update, nodes past it are removed
+	int32 NumNodes;
+	//Added or moved nodes, with their index
+	TArray<TPair<int32, FVector>> Nodes;
+	//Number of panels after the update, panels past it are removed
+	int32 NumPanels;
+	//Added or modified panels, with their index
+	TArray<TPair<int32, FNoxelRendererPanelData>> Panels;
+
+	FNoxelRendererDelta()
+		: NumNodes(0),
+		Nodes(),
+		NumPanels(0),
+		Panels()
 	{}
-};
\ No newline at end of file
+};
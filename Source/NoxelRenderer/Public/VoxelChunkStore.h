@@ -0,0 +1,201 @@
+//Copyright 2016-2020 Gabriel Zerbib (Moddingear). All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Occupancy of a 16x16x16 block of cubes, one bit per cube
+struct FVoxelChunk
+{
+	static constexpr int32 Size = 16;
+	static constexpr int32 NumWords = Size * Size * Size / 64;
+
+	uint64 Bits[NumWords];
+	int32 NumCubes;
+
+	FVoxelChunk()
+		: NumCubes(0)
+	{
+		FMemory::Memzero(Bits);
+	}
+
+	//Index of a cube inside the chunk, X varying fastest
+	static FORCEINLINE int32 LocalIndex(int32 X, int32 Y, int32 Z)
+	{
+		return X + (Y + Z * Size) * Size;
+	}
+
+	FORCEINLINE bool Get(int32 Index) const
+	{
+		return (Bits[Index >> 6] >> (Index & 63)) & 1;
+	}
+
+	FORCEINLINE bool Get(int32 X, int32 Y, int32 Z) const
+	{
+		return Get(LocalIndex(X, Y, Z));
+	}
+
+	//Fills the cubes from Start to Start + Count - 1, by index, doesn't update NumCubes
+	void FillRange(int32 Start, int32 Count);
+};
+
+//Result of a ray cast against the cubes
+struct FVoxelRayHit
+{
+	FIntVector Cube = FIntVector::ZeroValue;
+	//Side of the cube the ray came through, null if the ray started inside the cube
+	FIntVector Normal = FIntVector::ZeroValue;
+	//Fraction of the segment travelled before entering the cube
+	float Time = 0.f;
+	bool bHit = false;
+};
+
+/**
+ * Set of cubes stored as a hash of 16^3 chunks of occupancy bits
+ * Lookups are one hash and one bit test, whatever the number of cubes
+ */
+class NOXELRENDERER_API FVoxelChunkStore
+{
+public:
+	static FORCEINLINE FIntVector CubeToChunk(const FIntVector& Cube)
+	{
+		//Arithmetic shifts floor negative coordinates, so that chunk -1 holds cubes -16 to -1
+		return FIntVector(Cube.X >> 4, Cube.Y >> 4, Cube.Z >> 4);
+	}
+
+	static FORCEINLINE int32 CubeToLocalIndex(const FIntVector& Cube)
+	{
+		return FVoxelChunk::LocalIndex(Cube.X & (FVoxelChunk::Size - 1), Cube.Y & (FVoxelChunk::Size - 1), Cube.Z & (FVoxelChunk::Size - 1));
+	}
+
+	static FORCEINLINE FIntVector LocalIndexToCube(const FIntVector& Chunk, int32 Index)
+	{
+		return Chunk * FVoxelChunk::Size + FIntVector(Index & 15, (Index >> 4) & 15, Index >> 8);
+	}
+
+	FORCEINLINE bool Contains(const FIntVector& Cube) const
+	{
+		const FVoxelChunk* Chunk = Chunks.Find(CubeToChunk(Cube));
+		return Chunk && Chunk->Get(CubeToLocalIndex(Cube));
+	}
+
+	FORCEINLINE const FVoxelChunk* FindChunk(const FIntVector& Chunk) const
+	{
+		return Chunks.Find(Chunk);
+	}
+
+	//Returns false if the cube was already there
+	bool Add(const FIntVector& Cube);
+
+	//Returns false if the cube wasn't there, chunks left empty are freed
+	bool Remove(const FIntVector& Cube);
+
+	//Replaces the cubes of a whole chunk
+	void SetChunk(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk);
+
+	void Empty();
+
+	int32 Num() const
+	{
+		return NumCubes;
+	}
+
+	const TMap<FIntVector, FVoxelChunk>& GetChunks() const
+	{
+		return Chunks;
+	}
+
+	void ToArray(TArray<FIntVector>& OutCubes) const;
+
+	//Box holding the centers of all the cubes, invalid if empty
+	FBox GetBounds() const;
+
+	//Box holding the centers of all the cubes of the chunks in use, larger than GetBounds but doesn't look at the cubes
+	FBox GetChunksBounds() const;
+
+	//Walks the cubes crossed by the segment in order (Amanatides & Woo) until one is filled
+	//Coordinates are in cubes, cube centers being on integer coordinates
+	bool Raycast(const FVector& Start, const FVector& End, FVoxelRayHit& OutHit) const;
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Chunks.GetAllocatedSize();
+	}
+
+	//Writes the cubes in the compact format read by FVoxelChunkReader
+	void Save(FArchive& Ar) const;
+	//Replaces the cubes by the ones read, returns false and leaves the cubes as they were if the data is malformed
+	bool Load(FArchive& Ar);
+
+	//Writes the cubes of a single chunk, without its location, read back by FVoxelChunkReader::ReadChunkCubes
+	static void SaveChunk(FArchive& Ar, const FVoxelChunk& Chunk);
+
+	//Calls Func(FIntVector Cube) for every cube, chunk by chunk
+	template<typename FuncType>
+	void ForEachCube(FuncType&& Func) const
+	{
+		for (const TPair<FIntVector, FVoxelChunk>& Chunk : Chunks)
+		{
+			ForEachCubeInChunk(Chunk.Key, Chunk.Value, Func);
+		}
+	}
+
+	template<typename FuncType>
+	static void ForEachCubeInChunk(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk, FuncType&& Func)
+	{
+		for (int32 WordIdx = 0; WordIdx < FVoxelChunk::NumWords; WordIdx++)
+		{
+			uint64 Word = Chunk.Bits[WordIdx];
+			while (Word)
+			{
+				const int32 Index = WordIdx * 64 + (int32)FMath::CountTrailingZeros64(Word);
+				Func(LocalIndexToCube(ChunkLocation, Index));
+				Word &= Word - 1;
+			}
+		}
+	}
+
+private:
+	TMap<FIntVector, FVoxelChunk> Chunks;
+	int32 NumCubes = 0;
+};
+
+/**
+ * Streaming decoder of the format written by FVoxelChunkStore::Save, giving one chunk at a time
+ * Format : chunk count, then for each chunk its location as zigzag varints relative to the previous chunk,
+ * followed by its cubes either as alternating runs of empty and filled cubes or as the raw occupancy bits, whichever is smaller
+ */
+class NOXELRENDERER_API FVoxelChunkReader
+{
+public:
+	enum class EChunkEncoding : uint8
+	{
+		Runs,
+		Bits
+	};
+
+	explicit FVoxelChunkReader(FArchive& InAr);
+
+	int32 Num() const
+	{
+		return NumChunks;
+	}
+
+	//Reads the next chunk, returns false once every chunk was read or if the data is malformed
+	bool ReadChunk(FIntVector& OutLocation, FVoxelChunk& OutChunk);
+
+	//Reads the cubes of a single chunk written by FVoxelChunkStore::SaveChunk, returns false if the data is malformed
+	static bool ReadChunkCubes(FArchive& Ar, FVoxelChunk& OutChunk);
+
+	bool IsError() const
+	{
+		return bError || Ar.IsError();
+	}
+
+private:
+	FArchive& Ar;
+	int32 NumChunks = 0;
+	int32 NumChunksRead = 0;
+	FIntVector PreviousLocation = FIntVector::ZeroValue;
+	bool bError = false;
+};
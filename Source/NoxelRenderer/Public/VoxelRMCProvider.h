@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "RuntimeMeshProvider.h"
+#include "VoxelChunkStore.h"
 #include "VoxelRMCProvider.generated.h"
 
 UCLASS(HideCategories = Object, BlueprintType)
@@ -13,9 +14,23 @@ class NOXELRENDERER_API UVoxelRMCProvider : public URuntimeMeshProvider
 private:
 	mutable FCriticalSection PropertySyncRoot;
 
-	TArray<FIntVector> Cubes;
+	FVoxelChunkStore Voxels;
 	float CubeRadius;
 
+	//Each chunk of cubes is rendered by its own section, so that an edit only remeshes the chunks it touches
+	//SectionId of each chunk that has cubes
+	TMap<FIntVector, int32> ChunkSections;
+	//Chunk rendered by each section, only valid if ChunkSections maps it back to the section
+	TArray<FIntVector> SectionChunks;
+	//Sections of the chunks that were emptied, given to the next new chunks so the section count stays bounded by the chunk count
+	TArray<int32> FreeSections;
+	//Number of sections created on the mesh, INDEX_NONE until initialized
+	int32 NumCreatedSections = INDEX_NONE;
+
+	//Collision boxes of each chunk, only the chunks that changed are rebuilt when the collision is
+	TMap<FIntVector, TArray<FRuntimeMeshCollisionBox>> ChunkCollisionBoxes;
+	TSet<FIntVector> DirtyCollisionChunks;
+
 	UPROPERTY()
 	UMaterialInterface* Material;
 
@@ -24,7 +39,13 @@ public:
 	UVoxelRMCProvider();
 
 	TArray<FIntVector> GetCubes() const;
-	void SetCubes(const TArray<FIntVector> InCubes);
+	void SetCubes(TArrayView<const FIntVector> InCubes);
+	void SetVoxels(const FVoxelChunkStore& InVoxels);
+	//Replaces the cubes of a single chunk, only that chunk and its neighbours get remeshed
+	void SetChunk(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk);
+	//Single cube edits, return false if nothing changed
+	bool AddCube(const FIntVector& Cube);
+	bool RemoveCube(const FIntVector& Cube);
 
 	float GetCubeRadius() const;
 	void SetCubeRadius(const float& InRadius);
@@ -32,9 +53,37 @@ public:
 	UMaterialInterface* GetVoxelMaterial() const;
 	void SetVoxelMaterial(UMaterialInterface* InMaterial);
 
+	//Builds the faces of the cubes that aren't covered by another cube
+	//If bGreedy, coplanar faces of a chunk are merged into rectangles, otherwise every face is its own quad
+	static void BuildVoxelMesh(const FVoxelChunkStore& InVoxels, float Radius, FRuntimeMeshRenderableMeshData& MeshData, bool bGreedy = true);
+
+	//Same as BuildVoxelMesh for the cubes of a single chunk, faces against the neighbouring chunks are culled too
+	static void BuildChunkMesh(const FVoxelChunkStore& InVoxels, const FIntVector& ChunkLocation, float Radius, FRuntimeMeshRenderableMeshData& MeshData, bool bGreedy = true);
+
+	//Covers the cubes of each chunk with as few boxes as it can, growing them along X, then Y, then Z
+	static void BuildVoxelCollisionBoxes(const FVoxelChunkStore& InVoxels, float Radius, TArray<FRuntimeMeshCollisionBox>& OutBoxes);
+
+	static void BuildChunkCollisionBoxes(const FIntVector& ChunkLocation, const FVoxelChunk& Chunk, float Radius, TArray<FRuntimeMeshCollisionBox>& OutBoxes);
+
 private:
 
-	void GetMeshData(TArray<FIntVector>& OutCubes, float& OutRadius);
+	//Copies the chunk of a section and the chunks next to it, returns false if the section has no cubes
+	bool GetSectionMeshData(int32 SectionId, FVoxelChunkStore& OutVoxels, FIntVector& OutChunk, float& OutRadius);
+
+	//Gives the section of a chunk, reusing a free one or allocating one if needed, PropertySyncRoot must be held
+	int32 GetChunkSection(const FIntVector& Chunk);
+	//Frees the section of a chunk that has no cubes anymore, PropertySyncRoot must be held
+	void FreeChunkSection(const FIntVector& Chunk);
+	//Marks a chunk dirty, freeing its section if it has no cubes anymore, PropertySyncRoot must be held
+	void MarkChunkDirty(const FIntVector& Chunk, TSet<int32>& OutDirtySections);
+	//Marks the chunk of the cube dirty, with the neighbouring chunks whose faces touch it, PropertySyncRoot must be held
+	void MarkCubeChunksDirty(const FIntVector& Cube, TSet<int32>& OutDirtySections);
+	//Marks every chunk dirty, PropertySyncRoot must be held
+	void MarkAllChunksDirty();
+	//Creates the sections of the chunks that appeared since the last call, returns false if not initialized yet
+	bool CreateMissingSections();
+	//Remeshes the sections and rebuilds the collision
+	void UpdateDirtySections(const TSet<int32>& DirtySections);
 
 
 protected: